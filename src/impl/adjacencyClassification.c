@@ -4,81 +4,133 @@
  * Released under the MIT license, see LICENSE.txt
  */
 
-#include <ctype.h>
-
 #include "cactus.h"
 #include "sonLib.h"
 #include "contigPaths.h"
+#include "eventSet.h"
 #include "adjacencyTraversal.h"
 #include "adjacencyClassification.h"
+#include "nCount.h"
+#include "parallel.h"
+#include "flowerHierarchy.h"
+
+/*
+ * The number of caps whose codes are computed by one job when building a cap code table.
+ */
+#define CAP_CODE_TABLE_JOB_SIZE 1024
+
+typedef struct _capCodeTableEntry {
+    Name capName; //The key of the entry.
+    enum CapCode capCode;
+    Cap *otherCap;
+    int64_t insertLength;
+    int64_t deleteLength;
+} CapCodeTableEntry;
+
+struct _capCodeTable {
+    CapCodeTableEntry *entries;
+    int64_t entryNumber;
+    stHash *capNamesToEntries;
+};
 
 int64_t getNumberOfNs(const char *string) {
-    int64_t j = 0;
-    for (int64_t i = 0; i < strlen(string); i++) {
-        if (toupper(string[i]) == 'N') {
-            j++;
-        }
-    }
-    return j;
+    return countNs(string, strlen(string));
 }
 
-static int64_t getNumberOfNsInSegment(Segment *segment) {
-    char *string = segment_getString(segment);
-    int64_t i = getNumberOfNs(string);
+static int64_t getNumberOfNsInInterval(Sequence *sequence, int64_t start, int64_t length, NRunIndex *nRunIndex) {
+    /*
+     * Counts the Ns in the positive strand interval, using the index if it covers the sequence.
+     */
+    if (nRunIndex != NULL) {
+        int64_t i = nRunIndex_countNs(nRunIndex, sequence_getMetaSequence(sequence), start, length);
+        if (i >= 0) {
+            return i;
+        }
+    }
+    char *string = sequence_getString(sequence, start, length, 1);
+    int64_t i = countNs(string, length);
     free(string);
     return i;
 }
 
-static int64_t getNumberOfNsInAdjacency(Cap *cap) {
-    char *cA = getTerminalAdjacencySubString(cap);
-    int64_t i = getNumberOfNs(cA);
-    free(cA);
-    return i;
+static int64_t getNumberOfNsInSegment(Segment *segment, NRunIndex *nRunIndex) {
+    segment = segment_getStrand(segment) ? segment : segment_getReverse(segment);
+    return getNumberOfNsInInterval(segment_getSequence(segment), segment_getStart(segment),
+            segment_getLength(segment), nRunIndex);
 }
 
-bool getCapGetAtEndOfPath(Cap *cap, Cap **pathEndCap,
-        int64_t *pathLength, int64_t *nCount, stList *haplotypeEventStrings, stList *contaminationEventStrings) {
-    //Account for length of adjacency
-    *pathLength += getTerminalAdjacencyLength(cap);
-    *nCount += getNumberOfNsInAdjacency(cap);
-
-    Segment *segment = getAdjacentCapsSegment(cap);
-    if (segment == NULL) {
-        *pathEndCap = cap_getAdjacency(getTerminalCap(cap));
-        assert(*pathEndCap != NULL);
+static int64_t getNumberOfNsInAdjacency(Cap *cap, NRunIndex *nRunIndex) {
+    if (getTerminalAdjacencyLength_ignoreAdjacencies) {
         return 0;
     }
-    Cap *adjacentCap = cap_getSide(cap) ? segment_get3Cap(segment)
-    : segment_get5Cap(segment);
-    assert(
-            cap_getName(adjacentCap) == cap_getName(
-                    cap_getAdjacency(getTerminalCap(cap))));
+    cap = getTerminalCap(cap);
+    Cap *adjacentCap = cap_getAdjacency(cap);
+    int64_t i = cap_getCoordinate(cap) - cap_getCoordinate(adjacentCap);
+    assert(i != 0);
+    return getNumberOfNsInInterval(cap_getSequence(cap),
+            (i > 0 ? cap_getCoordinate(adjacentCap) : cap_getCoordinate(cap)) + 1, (i > 0 ? i : -i) - 1, nRunIndex);
+}
 
-    End *adjacentEnd = cap_getEnd(adjacentCap);
-    if (hasCapInEvents(adjacentEnd, contaminationEventStrings) || hasCapInEvents(adjacentEnd, haplotypeEventStrings)) { //hasCapNotInEvent(adjacentEnd, event_getHeader(cap_getEvent(cap)))) { //isContaminationEnd(adjacentEnd) || isHaplotypeEnd(adjacentEnd)) {
-        *pathEndCap = adjacentCap;
-        return 1;
-    }
-    *pathLength += segment_getLength(segment);
-    *nCount += getNumberOfNsInSegment(segment);
-    return getCapGetAtEndOfPath(cap_getOtherSegmentCap(adjacentCap),
-            pathEndCap, pathLength, nCount, haplotypeEventStrings, contaminationEventStrings);
-}
-
-static int64_t getBoundingNsP(Segment *segment) {
-    char *string = segment_getString(segment);
-    assert(string != NULL);
-    int64_t k = 0;
-    for (int64_t j = 0; j < strlen(string) && j < 5; j++) {
-        if (toupper(string[j]) == 'N') {
-            k++;
+static bool getCapGetAtEndOfPathP(Cap *cap, Cap **pathEndCap,
+        int64_t *pathLength, int64_t *nCount, EventSet *haplotypeEventSet, EventSet *contaminationEventSet,
+        NRunIndex *nRunIndex) {
+    /*
+     * Walks the adjacencies and intervening segments from the cap until reaching a haplotype or contamination end
+     * (returns non-zero) or a stub (returns zero). Iterative, as the path may contain very many segments.
+     */
+    while (1) {
+        //Account for length of adjacency
+        *pathLength += getTerminalAdjacencyLength(cap);
+        *nCount += getNumberOfNsInAdjacency(cap, nRunIndex);
+
+        Segment *segment = getAdjacentCapsSegment(cap);
+        if (segment == NULL) {
+            *pathEndCap = cap_getAdjacency(getTerminalCap(cap));
+            assert(*pathEndCap != NULL);
+            return 0;
+        }
+        Cap *adjacentCap = cap_getSide(cap) ? segment_get3Cap(segment)
+        : segment_get5Cap(segment);
+        assert(
+                cap_getName(adjacentCap) == cap_getName(
+                        cap_getAdjacency(getTerminalCap(cap))));
+
+        End *adjacentEnd = cap_getEnd(adjacentCap);
+        if (hasCapInEventSet(adjacentEnd, contaminationEventSet) || hasCapInEventSet(adjacentEnd, haplotypeEventSet)) { //hasCapNotInEvent(adjacentEnd, event_getHeader(cap_getEvent(cap)))) { //isContaminationEnd(adjacentEnd) || isHaplotypeEnd(adjacentEnd)) {
+            *pathEndCap = adjacentCap;
+            return 1;
         }
+        *pathLength += segment_getLength(segment);
+        *nCount += getNumberOfNsInSegment(segment, nRunIndex);
+        cap = cap_getOtherSegmentCap(adjacentCap);
     }
-    free(string);
-    return k;
 }
 
-static int64_t getBoundingNs(Cap *cap) {
+bool getCapGetAtEndOfPath(Cap *cap, Cap **pathEndCap,
+        int64_t *pathLength, int64_t *nCount, stList *haplotypeEventStrings, stList *contaminationEventStrings) {
+    Flower *flower = end_getFlower(cap_getEnd(cap));
+    EventSet *haplotypeEventSet = eventSet_construct(flower, haplotypeEventStrings);
+    EventSet *contaminationEventSet = eventSet_construct(flower, contaminationEventStrings);
+    bool b = getCapGetAtEndOfPathP(cap, pathEndCap, pathLength, nCount, haplotypeEventSet, contaminationEventSet, NULL);
+    eventSet_destruct(haplotypeEventSet);
+    eventSet_destruct(contaminationEventSet);
+    return b;
+}
+
+static int64_t getBoundingNsP(Segment *segment, NRunIndex *nRunIndex) {
+    /*
+     * Counts the Ns in the first (up to) five bases of the segment.
+     * As N is its own complement only the positions of the bases matter, not the strand.
+     */
+    Segment *positiveSegment = segment_getStrand(segment) ? segment : segment_getReverse(segment);
+    int64_t length = segment_getLength(positiveSegment);
+    int64_t k = length < 5 ? length : 5;
+    int64_t start = segment_getStrand(segment) ? segment_getStart(positiveSegment)
+            : segment_getStart(positiveSegment) + length - k;
+    return getNumberOfNsInInterval(segment_getSequence(positiveSegment), start, k, nRunIndex);
+}
+
+static int64_t getBoundingNs(Cap *cap, NRunIndex *nRunIndex) {
     assert(cap != NULL);
     Segment *segment = getCapsSegment(cap);
     if (segment == NULL) {
@@ -91,10 +143,10 @@ static int64_t getBoundingNs(Cap *cap) {
     assert(_3TerminalCap != NULL);
     //return 0;
     if (cap_getName(_5TerminalCap) == cap_getName(cap)) {
-        return getBoundingNsP(segment);
+        return getBoundingNsP(segment, nRunIndex);
     } else {
         assert(cap_getName(_3TerminalCap) == cap_getName(cap));
-        return getBoundingNsP(segment_getReverse(segment));
+        return getBoundingNsP(segment_getReverse(segment), nRunIndex);
     }
 }
 
@@ -104,6 +156,8 @@ CapCodeParameters *capCodeParameters_construct(int64_t minimumNCount,
     capCodeParameters->minimumNCount = minimumNCount;
     capCodeParameters->maxInsertionLength = maxInsertionLength;
     capCodeParameters->maxDeletionLength = maxDeletionLength;
+    capCodeParameters->nRunIndex = NULL;
+    capCodeParameters->capCodeTable = NULL;
     return capCodeParameters;
 }
 
@@ -111,56 +165,26 @@ void capCodeParameters_destruct(CapCodeParameters *capCodeParameters) {
     free(capCodeParameters);
 }
 
-static stSortedSet *getEventStrings(End *end, stList *eventStrings) {
-    stSortedSet *eventStringsSet = stSortedSet_construct3(
-            (int(*)(const void *, const void *)) strcmp, NULL);
-    End_InstanceIterator *instanceIt = end_getInstanceIterator(end);
-    Cap *cap;
-    while ((cap = end_getNext(instanceIt)) != NULL) {
-        const char *header = event_getHeader(cap_getEvent(cap));
-        for(int64_t i=0; i<stList_length(eventStrings); i++) {
-            if(strcmp(stList_get(eventStrings, i), header) == 0) {
-                stSortedSet_insert(eventStringsSet,
-                                   (void *) header);
-            }
-        }
-    }
-    end_destructInstanceIterator(instanceIt);
-    return eventStringsSet;
-}
-
-static enum CapCode getHaplotypeSwitchCode(Cap *cap, stList *eventStrings) {
+static enum CapCode getHaplotypeSwitchCode(Cap *cap, EventSet *eventSet) {
     Cap *adjacentCap = cap_getAdjacency(getTerminalCap(cap));
     assert(adjacentCap != NULL);
     End *end = cap_getEnd(cap);
     End *adjacentEnd = cap_getEnd(adjacentCap);
-    stSortedSet *eventStringsForEnd1 = getEventStrings(end, eventStrings);
-    stSortedSet *eventStringsForEnd2 = getEventStrings(adjacentEnd, eventStrings);
-
-    assert(stSortedSet_size(eventStringsForEnd1) > 0);
-    assert(stSortedSet_size(eventStringsForEnd2) > 0);
+    const uint64_t *eventsForEnd1 = eventSet_getCachedEndMask(eventSet, end);
+    const uint64_t *eventsForEnd2 = eventSet_getCachedEndMask(eventSet, adjacentEnd);
 
-    stSortedSet *intersectionOfEventStrings = stSortedSet_getIntersection(
-            eventStringsForEnd1, eventStringsForEnd2);
+    assert(eventSet_maskIsNonEmpty(eventSet, eventsForEnd1));
+    assert(eventSet_maskIsNonEmpty(eventSet, eventsForEnd2));
 
-    enum CapCode code1 = (stSortedSet_size(intersectionOfEventStrings)
-            != stSortedSet_size(eventStringsForEnd1) || stSortedSet_size(
-                    intersectionOfEventStrings)
-            != stSortedSet_size(eventStringsForEnd2)) ? HAP_SWITCH
+    return memcmp(eventsForEnd1, eventsForEnd2, sizeof(uint64_t) * eventSet_getMaskWordNumber(eventSet)) != 0 ? HAP_SWITCH
     : HAP_NOTHING;
-
-    stSortedSet_destruct(eventStringsForEnd1);
-    stSortedSet_destruct(eventStringsForEnd2);
-    stSortedSet_destruct(intersectionOfEventStrings);
-
-    return code1;
 }
 
-enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings, stList *contaminationEventStrings, int64_t *insertLength,
+static enum CapCode getCapCodeInEventSetsP(Cap *cap, Cap **otherCap, EventSet *haplotypeEventSet, EventSet *contaminationEventSet, int64_t *insertLength,
         int64_t *deleteLength, CapCodeParameters *capCodeParameters) {
-    assert(hasCapInEvents(cap_getEnd(cap), haplotypeEventStrings));
-    if (trueAdjacency(cap, haplotypeEventStrings)) {
-        return getHaplotypeSwitchCode(cap, haplotypeEventStrings);
+    assert(hasCapInEventSet(cap_getEnd(cap), haplotypeEventSet));
+    if (trueAdjacencyInEventSet(cap, haplotypeEventSet)) {
+        return getHaplotypeSwitchCode(cap, haplotypeEventSet);
     }
     *insertLength = 0;
     *deleteLength = 0;
@@ -168,17 +192,17 @@ enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings,
     End *end = cap_getEnd(cap);
     Cap *pathEndCap = NULL;
     int64_t pathLength = 0, nCount = 0;
-    bool pathEndsOnStub = !getCapGetAtEndOfPath(cap, &pathEndCap, &pathLength,
-            &nCount, haplotypeEventStrings, contaminationEventStrings);
+    bool pathEndsOnStub = !getCapGetAtEndOfPathP(cap, &pathEndCap, &pathLength,
+            &nCount, haplotypeEventSet, contaminationEventSet, capCodeParameters->nRunIndex);
     *otherCap = pathEndCap;
     assert(pathLength >= 0);
     assert(nCount >= 0);
     assert(pathEndCap != NULL);
     End *otherPathEnd = cap_getEnd(pathEndCap);
-    nCount += getBoundingNs(cap) + getBoundingNs(pathEndCap);
+    nCount += getBoundingNs(cap, capCodeParameters->nRunIndex) + getBoundingNs(pathEndCap, capCodeParameters->nRunIndex);
 
     if (pathEndsOnStub) {
-        assert(!hasCapInEvents(otherPathEnd, contaminationEventStrings)); //Can not test for hap event strings, as a stub end may contain the reference.
+        assert(!hasCapInEventSet(otherPathEnd, contaminationEventSet)); //Can not test for hap event strings, as a stub end may contain the reference.
         //assert(!hasCapInEvents(otherPathEnd, haplotypeEventStrings)); //isHaplotypeEnd(otherPathEnd) && !isContaminationEnd(otherPathEnd));
         return pathLength == 0 ? CONTIG_END
         : (nCount >= 1 ? (nCount >= capCodeParameters->minimumNCount ? CONTIG_END_WITH_SCAFFOLD_GAP
@@ -186,12 +210,12 @@ enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings,
                 : ERROR_CONTIG_END_WITH_INSERT);
     }
 
-    if (hasCapInEvents(otherPathEnd, haplotypeEventStrings)) {
-        if (endsAreConnected(end, otherPathEnd, haplotypeEventStrings)) {
+    if (hasCapInEventSet(otherPathEnd, haplotypeEventSet)) {
+        if (endsAreConnectedInEventSet(end, otherPathEnd, haplotypeEventSet)) {
             int64_t minimumHaplotypeDistanceBetweenEnds;
             //Establish if indel or order breaking rearrangement
-            if (endsAreAdjacent(end, otherPathEnd,
-                            &minimumHaplotypeDistanceBetweenEnds, haplotypeEventStrings)) {
+            if (endsAreAdjacentInEventSet(end, otherPathEnd,
+                            &minimumHaplotypeDistanceBetweenEnds, haplotypeEventSet)) {
                 *insertLength = pathLength;
                 *deleteLength = minimumHaplotypeDistanceBetweenEnds;
                 if (nCount >= capCodeParameters->minimumNCount) { //Insertion was scaffold gap
@@ -227,3 +251,210 @@ enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings,
         : ERROR_HAP_TO_INSERT_TO_CONTAMINATION;
     }
 }
+
+enum CapCode getCapCodeInEventSets(Cap *cap, Cap **otherCap, EventSet *haplotypeEventSet, EventSet *contaminationEventSet, int64_t *insertLength,
+        int64_t *deleteLength, CapCodeParameters *capCodeParameters) {
+    enum CapCode capCode;
+    if (capCodeParameters->capCodeTable != NULL
+            && capCodeTable_getCapCode(capCodeParameters->capCodeTable, cap, &capCode, otherCap, insertLength, deleteLength)) {
+#ifndef NDEBUG
+        //Check the table entry against the computed code.
+        Cap *otherCap2 = NULL;
+        int64_t insertLength2 = 0, deleteLength2 = 0;
+        enum CapCode capCode2 = getCapCodeInEventSetsP(cap, &otherCap2, haplotypeEventSet, contaminationEventSet,
+                &insertLength2, &deleteLength2, capCodeParameters);
+        assert(capCode == capCode2);
+        assert(capCode == HAP_SWITCH || capCode == HAP_NOTHING
+                || (*otherCap == otherCap2 && *insertLength == insertLength2 && *deleteLength == deleteLength2));
+#endif
+        return capCode;
+    }
+    return getCapCodeInEventSetsP(cap, otherCap, haplotypeEventSet, contaminationEventSet, insertLength, deleteLength,
+            capCodeParameters);
+}
+
+enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings, stList *contaminationEventStrings, int64_t *insertLength,
+        int64_t *deleteLength, CapCodeParameters *capCodeParameters) {
+    Flower *flower = end_getFlower(cap_getEnd(cap));
+    EventSet *haplotypeEventSet = eventSet_construct(flower, haplotypeEventStrings);
+    EventSet *contaminationEventSet = eventSet_construct(flower, contaminationEventStrings);
+    enum CapCode capCode = getCapCodeInEventSets(cap, otherCap, haplotypeEventSet, contaminationEventSet, insertLength, deleteLength, capCodeParameters);
+    eventSet_destruct(haplotypeEventSet);
+    eventSet_destruct(contaminationEventSet);
+    return capCode;
+}
+
+void getCapCodesInEventSets(Cap **caps, int64_t capNumber, enum CapCode *capCodes, Cap **otherCaps,
+        int64_t *insertLengths, int64_t *deleteLengths, EventSet *haplotypeEventSet, EventSet *contaminationEventSet,
+        CapCodeParameters *capCodeParameters) {
+    for (int64_t i = 0; i < capNumber; i++) {
+        otherCaps[i] = NULL;
+        insertLengths[i] = 0;
+        deleteLengths[i] = 0;
+        capCodes[i] = getCapCodeInEventSets(caps[i], &otherCaps[i], haplotypeEventSet, contaminationEventSet,
+                &insertLengths[i], &deleteLengths[i], capCodeParameters);
+    }
+}
+
+void getCapCodes(Cap **caps, int64_t capNumber, enum CapCode *capCodes, Cap **otherCaps,
+        int64_t *insertLengths, int64_t *deleteLengths, stList *haplotypeEventStrings, stList *contaminationEventStrings,
+        CapCodeParameters *capCodeParameters) {
+    if (capNumber == 0) {
+        return;
+    }
+    Flower *flower = end_getFlower(cap_getEnd(caps[0]));
+    EventSet *haplotypeEventSet = eventSet_construct(flower, haplotypeEventStrings);
+    EventSet *contaminationEventSet = eventSet_construct(flower, contaminationEventStrings);
+    getCapCodesInEventSets(caps, capNumber, capCodes, otherCaps, insertLengths, deleteLengths,
+            haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    eventSet_destruct(haplotypeEventSet);
+    eventSet_destruct(contaminationEventSet);
+}
+
+static uint64_t nameHashKey(const void *name) {
+    return *(const Name *) name;
+}
+
+static int nameEqualsKey(const void *name1, const void *name2) {
+    return *(const Name *) name1 == *(const Name *) name2;
+}
+
+typedef struct _capCodeTableJobs {
+    Cap **caps;
+    CapCodeTableEntry *entries;
+    int64_t entryNumber;
+    EventSet **haplotypeEventSets; //One pair of event sets per thread, as their caches are not thread safe.
+    EventSet **contaminationEventSets;
+    CapCodeParameters *capCodeParameters;
+} CapCodeTableJobs;
+
+static void capCodeTableJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    CapCodeTableJobs *jobs = extraArg;
+    int64_t end = (jobIndex + 1) * CAP_CODE_TABLE_JOB_SIZE;
+    end = end < jobs->entryNumber ? end : jobs->entryNumber;
+    for (int64_t i = jobIndex * CAP_CODE_TABLE_JOB_SIZE; i < end; i++) {
+        CapCodeTableEntry *entry = &jobs->entries[i];
+        Cap *cap = cap_getPositiveOrientation(jobs->caps[i]); //Entries are for the positive orientation of the cap.
+        entry->capName = cap_getName(cap);
+        entry->otherCap = NULL;
+        entry->insertLength = 0;
+        entry->deleteLength = 0;
+        entry->capCode = getCapCodeInEventSetsP(cap, &entry->otherCap, jobs->haplotypeEventSets[threadIndex],
+                jobs->contaminationEventSets[threadIndex], &entry->insertLength, &entry->deleteLength, jobs->capCodeParameters);
+    }
+}
+
+CapCodeTable *capCodeTable_construct(Flower *flower, const char *chosenEventString, stList *haplotypeEventStrings,
+        stList *contaminationEventStrings, CapCodeParameters *capCodeParameters, int64_t threadNumber) {
+    if (threadNumber < 1 || capCodeParameters->nRunIndex == NULL) {
+        threadNumber = 1;
+    }
+    CapCodeTableJobs jobs;
+    jobs.capCodeParameters = capCodeParameters;
+    jobs.haplotypeEventSets = st_malloc(sizeof(EventSet *) * threadNumber);
+    jobs.contaminationEventSets = st_malloc(sizeof(EventSet *) * threadNumber);
+    jobs.haplotypeEventSets[0] = eventSet_construct(flower, haplotypeEventStrings);
+    jobs.contaminationEventSets[0] = eventSet_construct(flower, contaminationEventStrings);
+    /*
+     * Gather the caps serially, as the walk loads the flowers, and build the terminal cap index if there is none, so
+     * that the threads only read objects that are already in memory.
+     */
+    EventSet *chosenEventSet = chosenEventString != NULL ? eventSet_construct2(flower, chosenEventString) : NULL;
+    stList *caps = stList_construct();
+    stList *flowers = getNestedFlowers(flower);
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(stList_get(flowers, i));
+        Segment *segment;
+        while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
+            if (chosenEventSet == NULL || eventSet_contains(chosenEventSet, segment_getEvent(segment))) {
+                Cap *_5Cap = segment_get5Cap(segment), *_3Cap = segment_get3Cap(segment);
+                if (hasCapInEventSet(cap_getEnd(_5Cap), jobs.haplotypeEventSets[0])) {
+                    stList_append(caps, _5Cap);
+                }
+                if (hasCapInEventSet(cap_getEnd(_3Cap), jobs.haplotypeEventSets[0])) {
+                    stList_append(caps, _3Cap);
+                }
+            }
+        }
+        flower_destructSegmentIterator(segmentIt);
+    }
+    stList_destruct(flowers);
+    if (chosenEventSet != NULL) {
+        eventSet_destruct(chosenEventSet);
+    }
+    //Ns are only counted without fetching sequence if the index covers the meta sequences of all the caps.
+    for (int64_t i = 0; i < stList_length(caps) && threadNumber > 1; i++) {
+        Cap *cap = stList_get(caps, i);
+        if (nRunIndex_countNs(capCodeParameters->nRunIndex, sequence_getMetaSequence(cap_getSequence(cap)), 0, 0) < 0) {
+            threadNumber = 1;
+        }
+    }
+    for (int64_t i = 1; i < threadNumber; i++) {
+        jobs.haplotypeEventSets[i] = eventSet_construct(flower, haplotypeEventStrings);
+        jobs.contaminationEventSets[i] = eventSet_construct(flower, contaminationEventStrings);
+    }
+    TerminalCapIndex *terminalCapIndex = NULL;
+    if (getTerminalCap_index == NULL && threadNumber > 1) {
+        terminalCapIndex = terminalCapIndex_construct(flower);
+        getTerminalCap_index = terminalCapIndex;
+    }
+
+    CapCodeTable *capCodeTable = st_malloc(sizeof(CapCodeTable));
+    capCodeTable->entryNumber = stList_length(caps);
+    capCodeTable->entries = st_malloc(sizeof(CapCodeTableEntry) * (capCodeTable->entryNumber + 1));
+    jobs.caps = st_malloc(sizeof(Cap *) * (capCodeTable->entryNumber + 1));
+    for (int64_t i = 0; i < capCodeTable->entryNumber; i++) {
+        jobs.caps[i] = stList_get(caps, i);
+    }
+    stList_destruct(caps);
+    jobs.entries = capCodeTable->entries;
+    jobs.entryNumber = capCodeTable->entryNumber;
+    runInParallel((jobs.entryNumber + CAP_CODE_TABLE_JOB_SIZE - 1) / CAP_CODE_TABLE_JOB_SIZE, threadNumber,
+            capCodeTableJob, &jobs);
+
+    capCodeTable->capNamesToEntries = stHash_construct3(nameHashKey, nameEqualsKey, NULL, NULL);
+    for (int64_t i = 0; i < capCodeTable->entryNumber; i++) {
+        assert(stHash_search(capCodeTable->capNamesToEntries, &capCodeTable->entries[i].capName) == NULL);
+        stHash_insert(capCodeTable->capNamesToEntries, &capCodeTable->entries[i].capName, &capCodeTable->entries[i]);
+    }
+
+    if (terminalCapIndex != NULL) {
+        getTerminalCap_index = NULL;
+        terminalCapIndex_destruct(terminalCapIndex);
+    }
+    for (int64_t i = 0; i < threadNumber; i++) {
+        eventSet_destruct(jobs.haplotypeEventSets[i]);
+        eventSet_destruct(jobs.contaminationEventSets[i]);
+    }
+    free(jobs.haplotypeEventSets);
+    free(jobs.contaminationEventSets);
+    free(jobs.caps);
+    return capCodeTable;
+}
+
+void capCodeTable_destruct(CapCodeTable *capCodeTable) {
+    stHash_destruct(capCodeTable->capNamesToEntries);
+    free(capCodeTable->entries);
+    free(capCodeTable);
+}
+
+int64_t capCodeTable_size(CapCodeTable *capCodeTable) {
+    return capCodeTable->entryNumber;
+}
+
+bool capCodeTable_getCapCode(CapCodeTable *capCodeTable, Cap *cap, enum CapCode *capCode, Cap **otherCap,
+        int64_t *insertLength, int64_t *deleteLength) {
+    Name capName = cap_getName(cap);
+    CapCodeTableEntry *entry = stHash_search(capCodeTable->capNamesToEntries, &capName);
+    if (entry == NULL) {
+        return 0;
+    }
+    *capCode = entry->capCode;
+    if (entry->capCode != HAP_SWITCH && entry->capCode != HAP_NOTHING) { //getCapCode leaves these unset for haplotype adjacencies.
+        assert(entry->otherCap != NULL);
+        *otherCap = cap_getOrientation(cap) ? entry->otherCap : cap_getReverse(entry->otherCap);
+        *insertLength = entry->insertLength;
+        *deleteLength = entry->deleteLength;
+    }
+    return 1;
+}
@@ -6,6 +6,7 @@
 
 #include "sonLib.h"
 #include "cactus.h"
+#include "eventSet.h"
 #include "adjacencyTraversal.h"
 
 bool getTerminalAdjacencyLength_ignoreAdjacencies = 0;
@@ -35,23 +36,64 @@ int64_t getTerminalAdjacencyLength(Cap *cap) {
     if(getTerminalAdjacencyLength_ignoreAdjacencies) {
         return 0;
     }
-    char *cA = getTerminalAdjacencySubString(cap);
-    int64_t i = strlen(cA);
-    free(cA);
-    return i;
+    /*
+     * Computed from the coordinates of the two caps, so that we never fetch the
+     * (possibly very long) intervening sequence just to measure it.
+     */
+    cap = getTerminalCap(cap);
+    Cap *adjacentCap = cap_getAdjacency(cap);
+    assert(adjacentCap != NULL);
+    int64_t i = cap_getCoordinate(cap) - cap_getCoordinate(adjacentCap);
+    assert(i != 0);
+    return (i > 0 ? i : -i) - 1;
 }
 
-Cap *getTerminalCap(Cap *cap) {
+TerminalCapIndex *getTerminalCap_index = NULL;
+
+typedef struct _terminalCapIndexEntry {
+    Name name; //Must be the first member, as the entry is keyed by a pointer to it.
+    Cap *terminalCap; //The positively oriented terminal cap.
+    Segment *segment; //The segment of the positively oriented cap, or NULL if it has none.
+} TerminalCapIndexEntry;
+
+struct _terminalCapIndex {
+    stHash *entries;
+};
+
+static uint64_t nameHashKey(const void *name) {
+    return *(const Name *) name;
+}
+
+static int nameEqualsKey(const void *name1, const void *name2) {
+    return *(const Name *) name1 == *(const Name *) name2;
+}
+
+static TerminalCapIndexEntry *terminalCapIndex_getEntry(TerminalCapIndex *terminalCapIndex, Cap *cap) {
+    Name name = cap_getName(cap);
+    return stHash_search(terminalCapIndex->entries, &name);
+}
+
+static Cap *getTerminalCapP(Cap *cap) {
     Flower *nestedFlower = group_getNestedFlower(end_getGroup(cap_getEnd(cap)));
     if (nestedFlower != NULL) {
         Cap *nestedCap = flower_getCap(nestedFlower, cap_getName(cap));
         assert(nestedCap != NULL);
-        return getTerminalCap(cap_getOrientation(cap) ? nestedCap : cap_getReverse(nestedCap));
+        return getTerminalCapP(cap_getOrientation(cap) ? nestedCap : cap_getReverse(nestedCap));
     }
     return cap;
 }
 
-Segment *getCapsSegment(Cap *cap) {
+Cap *getTerminalCap(Cap *cap) {
+    if (getTerminalCap_index != NULL) {
+        TerminalCapIndexEntry *entry = terminalCapIndex_getEntry(getTerminalCap_index, cap);
+        if (entry != NULL) {
+            return cap_getOrientation(cap) ? entry->terminalCap : cap_getReverse(entry->terminalCap);
+        }
+    }
+    return getTerminalCapP(cap);
+}
+
+static Segment *getCapsSegmentP(Cap *cap) {
     if (cap_getSegment(cap) != NULL) {
         return cap_getSegment(cap);
     }
@@ -66,7 +108,7 @@ Segment *getCapsSegment(Cap *cap) {
             if (!cap_getOrientation(cap)) {
                 parentCap = cap_getReverse(parentCap);
             }
-            return getCapsSegment(parentCap);
+            return getCapsSegmentP(parentCap);
         } else { //Cap must be a free stub end.
             assert(0); //Not in the current alignments.
             assert(end_isFree(cap_getEnd(cap)));
@@ -75,6 +117,105 @@ Segment *getCapsSegment(Cap *cap) {
     return NULL;
 }
 
+Segment *getCapsSegment(Cap *cap) {
+    if (getTerminalCap_index != NULL) {
+        TerminalCapIndexEntry *entry = terminalCapIndex_getEntry(getTerminalCap_index, cap);
+        if (entry != NULL) {
+            if (entry->segment == NULL) {
+                return NULL;
+            }
+            return cap_getOrientation(cap) ? entry->segment : segment_getReverse(entry->segment);
+        }
+    }
+    return getCapsSegmentP(cap);
+}
+
+static void terminalCapIndex_constructP(TerminalCapIndex *terminalCapIndex, Flower *flower) {
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        cap = cap_getPositiveOrientation(cap);
+        TerminalCapIndexEntry *entry = terminalCapIndex_getEntry(terminalCapIndex, cap);
+        if (entry == NULL) {
+            entry = st_calloc(1, sizeof(TerminalCapIndexEntry));
+            entry->name = cap_getName(cap);
+            stHash_insert(terminalCapIndex->entries, &entry->name, entry);
+        }
+        if (group_getNestedFlower(end_getGroup(cap_getEnd(cap))) == NULL) {
+            assert(entry->terminalCap == NULL);
+            entry->terminalCap = cap;
+        }
+        if (cap_getSegment(cap) != NULL) {
+            assert(entry->segment == NULL);
+            entry->segment = cap_getSegment(cap);
+        }
+    }
+    flower_destructCapIterator(capIt);
+    //Recurse over the flowers
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        if (group_getNestedFlower(group) != NULL) {
+            terminalCapIndex_constructP(terminalCapIndex, group_getNestedFlower(group));
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+
+#ifndef NDEBUG
+static void terminalCapIndex_check(TerminalCapIndex *terminalCapIndex, Flower *flower) {
+    /*
+     * Checks the index against walking the hierarchy, for every cap. Lookups may be made by several threads,
+     * which must not walk the hierarchy, so the check is made here, serially, rather than in getTerminalCap.
+     */
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        TerminalCapIndexEntry *entry = terminalCapIndex_getEntry(terminalCapIndex, cap);
+        assert(entry != NULL);
+        assert(entry->terminalCap == cap_getPositiveOrientation(getTerminalCapP(cap)));
+    }
+    flower_destructCapIterator(capIt);
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        if (group_getNestedFlower(group) != NULL) {
+            terminalCapIndex_check(terminalCapIndex, group_getNestedFlower(group));
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+#endif
+
+TerminalCapIndex *terminalCapIndex_construct(Flower *flower) {
+    TerminalCapIndex *terminalCapIndex = st_malloc(sizeof(TerminalCapIndex));
+    terminalCapIndex->entries = stHash_construct3(nameHashKey, nameEqualsKey, NULL, free);
+    terminalCapIndex_constructP(terminalCapIndex, flower);
+    /*
+     * Caps whose segment lies above the given flower have not been resolved by the walk, so
+     * resolve them by walking up the hierarchy now, so that lookups never have to.
+     */
+    stHashIterator *entryIt = stHash_getIterator(terminalCapIndex->entries);
+    Name *name;
+    while ((name = stHash_getNext(entryIt)) != NULL) {
+        TerminalCapIndexEntry *entry = stHash_search(terminalCapIndex->entries, name);
+        assert(entry->terminalCap != NULL);
+        if (entry->segment == NULL) {
+            entry->segment = getCapsSegmentP(entry->terminalCap);
+        }
+    }
+    stHash_destructIterator(entryIt);
+#ifndef NDEBUG
+    terminalCapIndex_check(terminalCapIndex, flower);
+#endif
+    return terminalCapIndex;
+}
+
+void terminalCapIndex_destruct(TerminalCapIndex *terminalCapIndex) {
+    stHash_destruct(terminalCapIndex->entries);
+    free(terminalCapIndex);
+}
+
 Segment *getAdjacentCapsSegment(Cap *cap) {
     cap = getTerminalCap(cap);
     cap = cap_getAdjacency(cap);
@@ -82,17 +223,7 @@ Segment *getAdjacentCapsSegment(Cap *cap) {
     return getCapsSegment(cap);
 }
 
-static bool capHasGivenEvents(Cap *cap, stList *eventStrings) {
-    const char *headerSeq = event_getHeader(cap_getEvent(cap));
-    for (int64_t i = 0; i < stList_length(eventStrings); i++) {
-        if (strcmp(headerSeq, stList_get(eventStrings, i)) == 0) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
-bool trueAdjacency(Cap *cap, stList *eventStrings) {
+bool trueAdjacencyInEventSet(Cap *cap, EventSet *eventSet) {
 	if(getTerminalAdjacencyLength(cap) > 0) {
         return 0;
     }
@@ -109,10 +240,9 @@ bool trueAdjacency(Cap *cap, stList *eventStrings) {
         Cap *otherCap2 = cap_getAdjacency(cap2);
         assert(otherCap2 != NULL);
         if (otherEnd == end_getPositiveOrientation(cap_getEnd(otherCap2))) {
-            //const char *eventName = event_getHeader(cap_getEvent(cap2));
-            assert(event_getHeader(cap_getEvent(cap2)) == event_getHeader(
+            assert(event_getName(cap_getEvent(cap2)) == event_getName(
                             cap_getEvent(otherCap2)));
-            if (capHasGivenEvents(cap2, eventStrings)) { //strcmp(eventName, "hapA1") == 0 || strcmp(eventName, "hapA2") == 0) {
+            if (eventSet_contains(eventSet, cap_getEvent(cap2))) {
                 if(getTerminalAdjacencyLength(cap2) == 0) {
                     end_destructInstanceIterator(endInstanceIt);
                     return 1;
@@ -124,6 +254,13 @@ bool trueAdjacency(Cap *cap, stList *eventStrings) {
     return 0;
 }
 
+bool trueAdjacency(Cap *cap, stList *eventStrings) {
+    EventSet *eventSet = eventSet_construct(end_getFlower(cap_getEnd(cap)), eventStrings);
+    bool b = trueAdjacencyInEventSet(cap, eventSet);
+    eventSet_destruct(eventSet);
+    return b;
+}
+
 bool hasCapInEvent(End *end, const char *eventString) {
     Cap *cap;
     End_InstanceIterator *instanceIt = end_getInstanceIterator(end);
@@ -150,38 +287,40 @@ bool hasCapNotInEvent(End *end, const char *eventString) {
     return 0;
 }
 
+bool hasCapInEventSet(End *end, EventSet *eventSet) {
+    return eventSet_maskIsNonEmpty(eventSet, eventSet_getCachedEndMask(eventSet, end));
+}
+
 bool hasCapInEvents(End *end, stList *eventStrings) {
-    for(int64_t i=0; i<stList_length(eventStrings); i++) {
-        if(hasCapInEvent(end, stList_get(eventStrings, i))) {
-            return 1;
-        }
-    }
-    return 0;
+    EventSet *eventSet = eventSet_construct(end_getFlower(end), eventStrings);
+    bool b = hasCapInEventSet(end, eventSet);
+    eventSet_destruct(eventSet);
+    return b;
 }
 
-bool endsAreConnected(End *end1, End *end2, stList *eventStrings) {
+bool endsAreConnectedInEventSet(End *end1, End *end2, EventSet *eventSet) {
     if (end_getName(end1) == end_getName(end2)) { //Then the ends are the same and are part of the same chromosome by definition.
         End_InstanceIterator *instanceIterator = end_getInstanceIterator(end1);
         Cap *cap1;
         while ((cap1 = end_getNext(instanceIterator)) != NULL) {
-            if (capHasGivenEvents(cap1, eventStrings)) {
+            if (eventSet_contains(eventSet, cap_getEvent(cap1))) {
                 end_destructInstanceIterator(instanceIterator);
                 return 1;
             }
         }
+        end_destructInstanceIterator(instanceIterator);
         return 0;
     }
     End_InstanceIterator *instanceIterator = end_getInstanceIterator(end1);
     Cap *cap1;
     while ((cap1 = end_getNext(instanceIterator)) != NULL) {
-        if (capHasGivenEvents(cap1, eventStrings)) {
+        if (eventSet_contains(eventSet, cap_getEvent(cap1))) {
             End_InstanceIterator *instanceIterator2 = end_getInstanceIterator(end2);
             Cap *cap2;
             while ((cap2 = end_getNext(instanceIterator2)) != NULL) {
                 assert(cap_getName(cap2) != cap_getName(cap1)); //This could only happen if end1 == end2
                 if (sequence_getMetaSequence(cap_getSequence(cap1)) == sequence_getMetaSequence(cap_getSequence(cap2))) {
-                    assert(strcmp(event_getHeader(cap_getEvent(cap1)),
-                                    event_getHeader(cap_getEvent(cap2))) == 0);
+                    assert(event_getName(cap_getEvent(cap1)) == event_getName(cap_getEvent(cap2)));
                     assert(cap_getPositiveOrientation(cap1)
                             != cap_getPositiveOrientation(cap2));
                     assert(cap_getName(cap1) != cap_getName(cap2));
@@ -199,11 +338,17 @@ bool endsAreConnected(End *end1, End *end2, stList *eventStrings) {
     return 0;
 }
 
+bool endsAreConnected(End *end1, End *end2, stList *eventStrings) {
+    EventSet *eventSet = eventSet_construct(end_getFlower(end1), eventStrings);
+    bool b = endsAreConnectedInEventSet(end1, end2, eventSet);
+    eventSet_destruct(eventSet);
+    return b;
+}
+
 bool capsAreAdjacent(Cap *cap1, Cap *cap2, int64_t *separationDistance) {
     if (cap_getName(cap2) != cap_getName(cap1) && cap_getCoordinate(cap1) != cap_getCoordinate(cap2)) { //This can happen if end1 == end2
         if (sequence_getMetaSequence(cap_getSequence(cap1)) == sequence_getMetaSequence(cap_getSequence(cap2))) {
-            assert(strcmp(event_getHeader(cap_getEvent(cap1)), event_getHeader(
-                                    cap_getEvent(cap2))) == 0);
+            assert(event_getName(cap_getEvent(cap1)) == event_getName(cap_getEvent(cap2)));
             assert(cap_getPositiveOrientation(cap1)
                     != cap_getPositiveOrientation(cap2));
             assert(cap_getName(cap1) != cap_getName(cap2));
@@ -234,7 +379,7 @@ bool capsAreAdjacent(Cap *cap1, Cap *cap2, int64_t *separationDistance) {
     return 0;
 }
 
-bool endsAreAdjacent2(End *end1, End *end2, Cap **returnCap1, Cap **returnCap2, int64_t *minimumDistanceBetweenHaplotypeCaps, stList *eventStrings) {
+bool endsAreAdjacent2InEventSet(End *end1, End *end2, Cap **returnCap1, Cap **returnCap2, int64_t *minimumDistanceBetweenHaplotypeCaps, EventSet *eventSet) {
     End_InstanceIterator *instanceIterator = end_getInstanceIterator(end1);
     Cap *cap1;
     *returnCap1 = NULL;
@@ -242,7 +387,7 @@ bool endsAreAdjacent2(End *end1, End *end2, Cap **returnCap1, Cap **returnCap2,
     *minimumDistanceBetweenHaplotypeCaps = INT64_MAX;
     bool areAdjacent = 0;
     while ((cap1 = end_getNext(instanceIterator)) != NULL) {
-        if (capHasGivenEvents(cap1, eventStrings)) {
+        if (eventSet_contains(eventSet, cap_getEvent(cap1))) {
             End_InstanceIterator *instanceIterator2 = end_getInstanceIterator(end2);
             Cap *cap2;
             while ((cap2 = end_getNext(instanceIterator2)) != NULL) {
@@ -263,6 +408,18 @@ bool endsAreAdjacent2(End *end1, End *end2, Cap **returnCap1, Cap **returnCap2,
     return areAdjacent;
 }
 
+bool endsAreAdjacent2(End *end1, End *end2, Cap **returnCap1, Cap **returnCap2, int64_t *minimumDistanceBetweenHaplotypeCaps, stList *eventStrings) {
+    EventSet *eventSet = eventSet_construct(end_getFlower(end1), eventStrings);
+    bool b = endsAreAdjacent2InEventSet(end1, end2, returnCap1, returnCap2, minimumDistanceBetweenHaplotypeCaps, eventSet);
+    eventSet_destruct(eventSet);
+    return b;
+}
+
+bool endsAreAdjacentInEventSet(End *end1, End *end2, int64_t *minimumDistanceBetweenHaplotypeCaps, EventSet *eventSet) {
+    Cap *cap1 = NULL, *cap2 = NULL;
+    return endsAreAdjacent2InEventSet(end1, end2, &cap1, &cap2, minimumDistanceBetweenHaplotypeCaps, eventSet);
+}
+
 bool endsAreAdjacent(End *end1, End *end2, int64_t *minimumDistanceBetweenHaplotypeCaps, stList *eventStrings) {
     Cap *cap1 = NULL, *cap2 = NULL;
     return endsAreAdjacent2(end1, end2, &cap1, &cap2, minimumDistanceBetweenHaplotypeCaps, eventStrings);
@@ -4,78 +4,145 @@
  * Released under the MIT license, see LICENSE.txt
  */
 
+#include <pthread.h>
+
 #include "sonLib.h"
 #include "cactus.h"
+#include "eventSet.h"
 #include "adjacencyTraversal.h"
+#include "parallel.h"
+#include "flowerHierarchy.h"
 #include "contigPaths.h"
 
+/*
+ * An open addressing (linear probing) hash set of segments. Segments are stored by their positive
+ * orientation, so one probe answers whether a segment or its reverse is in the set.
+ */
+typedef struct _segmentSet {
+    Segment **table;
+    int64_t tableSize; //Always a power of two.
+    int64_t segmentNumber;
+} SegmentSet;
+
+static SegmentSet *segmentSet_construct(void) {
+    SegmentSet *segmentSet = st_malloc(sizeof(SegmentSet));
+    segmentSet->tableSize = 1024;
+    segmentSet->segmentNumber = 0;
+    segmentSet->table = st_calloc(segmentSet->tableSize, sizeof(Segment *));
+    return segmentSet;
+}
+
+static void segmentSet_destruct(SegmentSet *segmentSet) {
+    free(segmentSet->table);
+    free(segmentSet);
+}
+
+static int64_t segmentSet_getSlot(SegmentSet *segmentSet, Segment *segment) {
+    /*
+     * Returns the slot containing the (positively oriented) segment, or the empty slot where it belongs.
+     */
+    uint64_t mask = segmentSet->tableSize - 1;
+    uint64_t i = (((uint64_t) (uintptr_t) segment) * 0x9E3779B97F4A7C15ULL) >> 17;
+    while (segmentSet->table[i & mask] != NULL && segmentSet->table[i & mask] != segment) {
+        i++;
+    }
+    return i & mask;
+}
+
+static bool segmentSet_contains(SegmentSet *segmentSet, Segment *segment) {
+    segment = segment_getStrand(segment) ? segment : segment_getReverse(segment);
+    return segmentSet->table[segmentSet_getSlot(segmentSet, segment)] != NULL;
+}
+
+/*
+ * Adds the segment to the set, returning non-zero iff neither it nor its reverse was already present.
+ */
+static bool segmentSet_insert(SegmentSet *segmentSet, Segment *segment) {
+    segment = segment_getStrand(segment) ? segment : segment_getReverse(segment);
+    int64_t i = segmentSet_getSlot(segmentSet, segment);
+    if (segmentSet->table[i] != NULL) {
+        return 0;
+    }
+    segmentSet->table[i] = segment;
+    if (++segmentSet->segmentNumber * 2 > segmentSet->tableSize) { //Keep the load factor at most a half.
+        Segment **table = segmentSet->table;
+        int64_t tableSize = segmentSet->tableSize;
+        segmentSet->tableSize *= 2;
+        segmentSet->table = st_calloc(segmentSet->tableSize, sizeof(Segment *));
+        for (int64_t j = 0; j < tableSize; j++) {
+            if (table[j] != NULL) {
+                segmentSet->table[segmentSet_getSlot(segmentSet, table[j])] = table[j];
+            }
+        }
+        free(table);
+    }
+    return 1;
+}
+
 static void getMaximalHaplotypePathsP3(Segment *segment,
-        stList *maximalHaplotypePath, stSortedSet *segmentSet, stList *eventStrings) {
-    stList_append(maximalHaplotypePath, segment);
-    assert(stSortedSet_search(segmentSet, segment) == NULL);
-    assert(stSortedSet_search(segmentSet, segment_getReverse(segment)) == NULL);
-    stSortedSet_insert(segmentSet, segment);
-    Cap *_3Cap = segment_get3Cap(segment);
-    if (trueAdjacency(_3Cap, eventStrings)) { //Continue on..
-        Segment *otherSegment = getAdjacentCapsSegment(_3Cap);
-        if (otherSegment != NULL) {
-            getMaximalHaplotypePathsP3(otherSegment, maximalHaplotypePath,
-                    segmentSet, eventStrings);
+        stList *maximalHaplotypePath, SegmentSet *segmentSet, EventSet *eventSet) {
+    /*
+     * Walks from the segment in the 3' direction, adding segments to the path until the
+     * adjacency is not supported. Iterative, as contigs may contain very many segments.
+     * If segmentSet is non-NULL the segments are also added to it.
+     */
+    while (segment != NULL) {
+        stList_append(maximalHaplotypePath, segment);
+        if (segmentSet != NULL) {
+            bool b = segmentSet_insert(segmentSet, segment);
+            (void) b;
+            assert(b);
         }
+        Cap *_3Cap = segment_get3Cap(segment);
+        segment = trueAdjacencyInEventSet(_3Cap, eventSet) ? getAdjacentCapsSegment(_3Cap) : NULL; //Continue on..
     }
 }
 
 static void getMaximalHaplotypePathsP2(Segment *segment,
-        stList *maximalHaplotypePath, stSortedSet *segmentSet, stList *eventStrings) {
+        stList *maximalHaplotypePath, SegmentSet *segmentSet, EventSet *eventSet) {
     /*
      * Iterate all the way to one end of the contig then start the traversal to define the maximal
      * haplotype path.
      */
-    Cap *_5Cap = segment_get5Cap(segment);
-    assert(hasCapInEvents(cap_getEnd(segment_get3Cap(segment)), eventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
-    if (trueAdjacency(_5Cap, eventStrings)) { //Check that the adjacency is supported by a haplotype path
+    while (1) {
+        Cap *_5Cap = segment_get5Cap(segment);
+        assert(hasCapInEventSet(cap_getEnd(segment_get3Cap(segment)), eventSet)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
+        if (!trueAdjacencyInEventSet(_5Cap, eventSet)) { //Check that the adjacency is supported by a haplotype path
+            break;
+        }
         Segment *otherSegment = getAdjacentCapsSegment(_5Cap);
         assert(segment != otherSegment);
         assert(segment_getReverse(segment) != otherSegment);
-        if (otherSegment != NULL) {
-            assert(stSortedSet_search(segmentSet, otherSegment) == NULL);
-            assert(stSortedSet_search(segmentSet, segment_getReverse(
-                    otherSegment)) == NULL);
-            assert(hasCapInEvents(cap_getEnd(segment_get3Cap(otherSegment)), eventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(otherSegment))));
-            getMaximalHaplotypePathsP2(otherSegment, maximalHaplotypePath,
-                    segmentSet, eventStrings);
-        } else { //We need to start the maximal haplotype recursion
-            getMaximalHaplotypePathsP3(segment, maximalHaplotypePath,
-                    segmentSet, eventStrings);
+        if (otherSegment == NULL) { //We need to start the maximal haplotype traversal
+            break;
         }
-    } else {
-        getMaximalHaplotypePathsP3(segment, maximalHaplotypePath, segmentSet, eventStrings);
+        assert(segmentSet == NULL || !segmentSet_contains(segmentSet, otherSegment));
+        assert(hasCapInEventSet(cap_getEnd(segment_get3Cap(otherSegment)), eventSet)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(otherSegment))));
+        segment = otherSegment;
     }
+    getMaximalHaplotypePathsP3(segment, maximalHaplotypePath, segmentSet, eventSet);
 }
 
 static void getMaximalHaplotypePathsP(Flower *flower,
-        stList *maximalHaplotypePaths, stSortedSet *segmentSet,
-        const char *eventString,
-        stList *eventStrings) {
+        stList *maximalHaplotypePaths, SegmentSet *segmentSet,
+        EventSet *chosenEventSet,
+        EventSet *eventSet) {
     /*
      *  Iterate through the segments in this flower.
      */
     Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
     Segment *segment;
     while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
-        if (stSortedSet_search(segmentSet, segment) == NULL
-                && stSortedSet_search(segmentSet, segment_getReverse(segment))
-                        == NULL) { //Check we haven't yet seen this segment
-            if (strcmp(event_getHeader(segment_getEvent(segment)), eventString)
-                    == 0) { //Check if the segment is in the assembly
-                if (hasCapInEvents(cap_getEnd(segment_get5Cap(segment)), eventStrings)) { //Is a block in a haplotype segment
-                    assert(hasCapInEvents(cap_getEnd(segment_get3Cap(segment)), eventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
+        if (!segmentSet_contains(segmentSet, segment)) { //Check we haven't yet seen this segment
+            if (eventSet_contains(chosenEventSet, segment_getEvent(segment))) { //Check if the segment is in the assembly
+                if (hasCapInEventSet(cap_getEnd(segment_get5Cap(segment)), eventSet)) { //Is a block in a haplotype segment
+                    assert(hasCapInEventSet(cap_getEnd(segment_get3Cap(segment)), eventSet)); //isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
                     stList *maximalHaplotypePath = stList_construct();
                     stList_append(maximalHaplotypePaths, maximalHaplotypePath);
                     getMaximalHaplotypePathsP2(segment, maximalHaplotypePath,
-                            segmentSet, eventStrings);
+                            segmentSet, eventSet);
                 } else {
-                    assert(!hasCapInEvents(cap_getEnd(segment_get3Cap(segment)), eventStrings));//assert(!isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
+                    assert(!hasCapInEventSet(cap_getEnd(segment_get3Cap(segment)), eventSet));//assert(!isHaplotypeEnd(cap_getEnd(segment_get3Cap(segment))));
                 }
             }
         }
@@ -89,82 +156,287 @@ static void getMaximalHaplotypePathsP(Flower *flower,
     while ((group = flower_getNextGroup(groupIt)) != NULL) {
         if (group_getNestedFlower(group) != NULL) {
             getMaximalHaplotypePathsP(group_getNestedFlower(group),
-                    maximalHaplotypePaths, segmentSet, eventString, eventStrings);
+                    maximalHaplotypePaths, segmentSet, chosenEventSet, eventSet);
         }
     }
     flower_destructGroupIterator(groupIt);
 }
 
+static void checkContigPathsCondition(bool condition, const char *description) {
+    if (!condition) {
+        st_errAbort("Invalid contig paths: %s", description);
+    }
+}
+
 static void getMaximalHaplotypePathsCheck(Flower *flower,
-        stSortedSet *segmentSet, const char *eventString, stList *eventStrings) {
+        SegmentSet *segmentSet, EventSet *chosenEventSet, EventSet *eventSet) {
     /*
-     * Do debug checks that the haplotypes paths are well formed.
+     * Checks that every haplotype segment of the chosen event in the hierarchy is in a contig path.
      */
-    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
-    Segment *segment;
-    while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
-        if (strcmp(event_getHeader(segment_getEvent(segment)), eventString) == 0) {
-            if (hasCapInEvents(cap_getEnd(segment_get5Cap(segment)), eventStrings)) { //isHaplotypeEnd(cap_getEnd(segment_get5Cap(segment)))) {
-                assert(stSortedSet_search(segmentSet, segment) != NULL
-                        || stSortedSet_search(segmentSet, segment_getReverse(
-                                segment)) != NULL);
+    stList *flowers = getNestedFlowers(flower);
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(stList_get(flowers, i));
+        Segment *segment;
+        while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
+            if (eventSet_contains(chosenEventSet, segment_getEvent(segment))) {
+                if (hasCapInEventSet(cap_getEnd(segment_get5Cap(segment)), eventSet)) { //isHaplotypeEnd(cap_getEnd(segment_get5Cap(segment)))) {
+                    checkContigPathsCondition(segmentSet_contains(segmentSet, segment), "a haplotype segment is in no contig path");
+                }
             }
         }
+        flower_destructSegmentIterator(segmentIt);
     }
-    flower_destructSegmentIterator(segmentIt);
-
-    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
-    Group *group;
-    while ((group = flower_getNextGroup(groupIt)) != NULL) {
-        if (group_getNestedFlower(group) != NULL) {
-            getMaximalHaplotypePathsCheck(group_getNestedFlower(group),
-                    segmentSet, eventString, eventStrings);
-        }
-    }
-    flower_destructGroupIterator(groupIt);
+    stList_destruct(flowers);
 }
 
-stList *getContigPaths(Flower *flower, const char *eventString, stList *eventStrings) {
-    stList *maximalHaplotypePaths = stList_construct3(0,
-            (void(*)(void *)) stList_destruct);
-    stSortedSet *segmentSet = stSortedSet_construct();
-    getMaximalHaplotypePathsP(flower, maximalHaplotypePaths, segmentSet, eventString, eventStrings);
-
-    //Do some debug checks..
-    st_logDebug("We have %" PRIi64 " maximal haplotype paths\n", stList_length(
-            maximalHaplotypePaths));
-    getMaximalHaplotypePathsCheck(flower, segmentSet, eventString, eventStrings);
+static void checkContigPathsP(Flower *flower, stList *maximalHaplotypePaths,
+        SegmentSet *segmentSet, EventSet *chosenEventSet, EventSet *eventSet) {
+    getMaximalHaplotypePathsCheck(flower, segmentSet, chosenEventSet, eventSet);
     for (int64_t i = 0; i < stList_length(maximalHaplotypePaths); i++) {
         stList *maximalHaplotypePath = stList_get(maximalHaplotypePaths, i);
         st_logDebug("We have a maximal haplotype path with length %" PRIi64 "\n",
                 stList_length(maximalHaplotypePath));
-        assert(stList_length(maximalHaplotypePath) > 0);
+        checkContigPathsCondition(stList_length(maximalHaplotypePath) > 0, "a contig path is empty");
         Segment *_5Segment = stList_get(maximalHaplotypePath, 0);
         Segment *_3Segment = stList_get(maximalHaplotypePath, stList_length(
                 maximalHaplotypePath) - 1);
         if (getAdjacentCapsSegment(segment_get5Cap(_5Segment)) != NULL) {
-            assert(!trueAdjacency(segment_get5Cap(_5Segment), eventStrings));
+            checkContigPathsCondition(!trueAdjacencyInEventSet(segment_get5Cap(_5Segment), eventSet),
+                    "a contig path can be extended at its 5' end");
         }
         if (getAdjacentCapsSegment(segment_get3Cap(_3Segment)) != NULL) {
-            assert(!trueAdjacency(segment_get3Cap(_3Segment), eventStrings));
+            checkContigPathsCondition(!trueAdjacencyInEventSet(segment_get3Cap(_3Segment), eventSet),
+                    "a contig path can be extended at its 3' end");
         }
         for (int64_t j = 0; j < stList_length(maximalHaplotypePath) - 1; j++) {
             _5Segment = stList_get(maximalHaplotypePath, j);
             _3Segment = stList_get(maximalHaplotypePath, j + 1);
-            assert(trueAdjacency(segment_get3Cap(_5Segment), eventStrings));
-            assert(trueAdjacency(segment_get5Cap(_3Segment), eventStrings));
-            assert(cap_getAdjacency(getTerminalCap(segment_get3Cap(_5Segment)))
-                    == getTerminalCap(segment_get5Cap(_3Segment)));
-            assert(strcmp(event_getHeader(segment_getEvent(_5Segment)),
-                   eventString) == 0);
-            assert(strcmp(event_getHeader(segment_getEvent(_3Segment)),
-                    eventString) == 0);
-            assert(hasCapInEvents(cap_getEnd(segment_get5Cap(_5Segment)), eventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get5Cap(_5Segment))));
-            assert(hasCapInEvents(cap_getEnd(segment_get5Cap(_3Segment)), eventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get5Cap(_3Segment))));
+            checkContigPathsCondition(trueAdjacencyInEventSet(segment_get3Cap(_5Segment), eventSet)
+                    && trueAdjacencyInEventSet(segment_get5Cap(_3Segment), eventSet)
+                    && cap_getAdjacency(getTerminalCap(segment_get3Cap(_5Segment))) == getTerminalCap(segment_get5Cap(_3Segment)),
+                    "consecutive segments of a contig path are not adjacent");
+            checkContigPathsCondition(eventSet_contains(chosenEventSet, segment_getEvent(_5Segment))
+                    && eventSet_contains(chosenEventSet, segment_getEvent(_3Segment)),
+                    "a segment of a contig path is not of the chosen event");
+            checkContigPathsCondition(hasCapInEventSet(cap_getEnd(segment_get5Cap(_5Segment)), eventSet)
+                    && hasCapInEventSet(cap_getEnd(segment_get5Cap(_3Segment)), eventSet),
+                    "a segment of a contig path is not a haplotype segment");
+        }
+    }
+}
+
+void checkContigPaths(Flower *flower, stList *contigPaths, const char *chosenEventString, stList *eventStrings) {
+    SegmentSet *segmentSet = segmentSet_construct();
+    for (int64_t i = 0; i < stList_length(contigPaths); i++) {
+        stList *contigPath = stList_get(contigPaths, i);
+        for (int64_t j = 0; j < stList_length(contigPath); j++) {
+            checkContigPathsCondition(segmentSet_insert(segmentSet, stList_get(contigPath, j)),
+                    "a segment is in more than one contig path");
         }
     }
+    EventSet *chosenEventSet = eventSet_construct2(flower, chosenEventString);
+    EventSet *eventSet = eventSet_construct(flower, eventStrings);
+    checkContigPathsP(flower, contigPaths, segmentSet, chosenEventSet, eventSet);
+    segmentSet_destruct(segmentSet);
+    eventSet_destruct(chosenEventSet);
+    eventSet_destruct(eventSet);
+}
 
-    stSortedSet_destruct(segmentSet);
+stList *getContigPaths(Flower *flower, const char *eventString, stList *eventStrings) {
+    stList *maximalHaplotypePaths = stList_construct3(0,
+            (void(*)(void *)) stList_destruct);
+    SegmentSet *segmentSet = segmentSet_construct();
+    EventSet *chosenEventSet = eventSet_construct2(flower, eventString);
+    EventSet *eventSet = eventSet_construct(flower, eventStrings);
+    getMaximalHaplotypePathsP(flower, maximalHaplotypePaths, segmentSet, chosenEventSet, eventSet);
+
+    st_logDebug("We have %" PRIi64 " maximal haplotype paths\n", stList_length(
+            maximalHaplotypePaths));
+#ifndef NDEBUG
+    checkContigPathsP(flower, maximalHaplotypePaths, segmentSet, chosenEventSet, eventSet);
+#endif
+
+    segmentSet_destruct(segmentSet);
+    eventSet_destruct(chosenEventSet);
+    eventSet_destruct(eventSet);
+
+    return maximalHaplotypePaths;
+}
+
+/*
+ * A segment set split into independently locked shards, so that threads rarely contend.
+ */
+#define SEGMENT_SET_SHARD_NUMBER 64
+
+typedef struct _shardedSegmentSet {
+    SegmentSet *shards[SEGMENT_SET_SHARD_NUMBER];
+    pthread_mutex_t mutexes[SEGMENT_SET_SHARD_NUMBER];
+} ShardedSegmentSet;
+
+static ShardedSegmentSet *shardedSegmentSet_construct(void) {
+    ShardedSegmentSet *segmentSet = st_malloc(sizeof(ShardedSegmentSet));
+    for (int64_t i = 0; i < SEGMENT_SET_SHARD_NUMBER; i++) {
+        segmentSet->shards[i] = segmentSet_construct();
+        pthread_mutex_init(&segmentSet->mutexes[i], NULL);
+    }
+    return segmentSet;
+}
+
+static void shardedSegmentSet_destruct(ShardedSegmentSet *segmentSet) {
+    for (int64_t i = 0; i < SEGMENT_SET_SHARD_NUMBER; i++) {
+        segmentSet_destruct(segmentSet->shards[i]);
+        pthread_mutex_destroy(&segmentSet->mutexes[i]);
+    }
+    free(segmentSet);
+}
+
+static int64_t shardedSegmentSet_getShard(Segment *segment) {
+    segment = segment_getStrand(segment) ? segment : segment_getReverse(segment);
+    return (int64_t) ((((uintptr_t) segment) >> 4) % SEGMENT_SET_SHARD_NUMBER);
+}
+
+static bool shardedSegmentSet_contains(ShardedSegmentSet *segmentSet, Segment *segment) {
+    int64_t i = shardedSegmentSet_getShard(segment);
+    pthread_mutex_lock(&segmentSet->mutexes[i]);
+    bool b = segmentSet_contains(segmentSet->shards[i], segment);
+    pthread_mutex_unlock(&segmentSet->mutexes[i]);
+    return b;
+}
+
+/*
+ * Adds the segment to the set, returning non-zero iff it was not already present.
+ */
+static bool shardedSegmentSet_insert(ShardedSegmentSet *segmentSet, Segment *segment) {
+    int64_t i = shardedSegmentSet_getShard(segment);
+    pthread_mutex_lock(&segmentSet->mutexes[i]);
+    bool b = segmentSet_insert(segmentSet->shards[i], segment);
+    pthread_mutex_unlock(&segmentSet->mutexes[i]);
+    return b;
+}
+
+typedef struct _contigPathJobs {
+    stList *flowers;
+    ShardedSegmentSet *segmentSet;
+    EventSet *chosenEventSet;
+    EventSet **eventSets; //One per thread, as event sets cache end masks.
+    stList **contigPaths; //One per thread.
+} ContigPathJobs;
+
+static void getContigPathsJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    ContigPathJobs *jobs = extraArg;
+    EventSet *eventSet = jobs->eventSets[threadIndex];
+    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(stList_get(jobs->flowers, jobIndex));
+    Segment *segment;
+    while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
+        if (eventSet_contains(jobs->chosenEventSet, segment_getEvent(segment))
+                && !shardedSegmentSet_contains(jobs->segmentSet, segment)
+                && hasCapInEventSet(cap_getEnd(segment_get5Cap(segment)), eventSet)) {
+            stList *contigPath = stList_construct();
+            getMaximalHaplotypePathsP2(segment, contigPath, NULL, eventSet);
+            /*
+             * Another thread may have built the same path concurrently, so claim it by its first or last segment, whichever
+             * has the lower address, and only keep it if the claim succeeds.
+             */
+            Segment *_5Segment = stList_get(contigPath, 0);
+            Segment *_3Segment = stList_get(contigPath, stList_length(contigPath) - 1);
+            _5Segment = segment_getStrand(_5Segment) ? _5Segment : segment_getReverse(_5Segment);
+            _3Segment = segment_getStrand(_3Segment) ? _3Segment : segment_getReverse(_3Segment);
+            Segment *key = _5Segment < _3Segment ? _5Segment : _3Segment;
+            if (shardedSegmentSet_insert(jobs->segmentSet, key)) {
+                for (int64_t i = 0; i < stList_length(contigPath); i++) {
+                    Segment *segment2 = stList_get(contigPath, i);
+                    if (segment2 != key && segment_getReverse(segment2) != key) {
+                        bool b = shardedSegmentSet_insert(jobs->segmentSet, segment2);
+                        (void) b;
+                        assert(b);
+                    }
+                }
+                stList_append(jobs->contigPaths[threadIndex], contigPath);
+            } else {
+                stList_destruct(contigPath);
+            }
+        }
+    }
+    flower_destructSegmentIterator(segmentIt);
+}
+
+static int contigPathCmpFn(const void *contigPath1, const void *contigPath2) {
+    return cactusMisc_nameCompare(segment_getName(stList_get((stList *) contigPath1, 0)),
+            segment_getName(stList_get((stList *) contigPath2, 0)));
+}
+
+stList *getContigPathsInParallel(Flower *flower, const char *eventString, stList *eventStrings, int64_t threadNumber) {
+    if (threadNumber < 1) {
+        threadNumber = 1;
+    }
+    /*
+     * Load every flower and build the terminal cap index up front, so that the threads only read
+     * objects that are already in memory and never walk the hierarchy.
+     */
+    stList *flowers = getNestedFlowers(flower);
+    TerminalCapIndex *previousTerminalCapIndex = getTerminalCap_index;
+    TerminalCapIndex *terminalCapIndex = terminalCapIndex_construct(flower);
+    getTerminalCap_index = terminalCapIndex;
+
+    ContigPathJobs jobs;
+    jobs.flowers = flowers;
+    jobs.segmentSet = shardedSegmentSet_construct();
+    jobs.chosenEventSet = eventSet_construct2(flower, eventString);
+    jobs.eventSets = st_malloc(sizeof(EventSet *) * threadNumber);
+    jobs.contigPaths = st_malloc(sizeof(stList *) * threadNumber);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        jobs.eventSets[i] = eventSet_construct(flower, eventStrings);
+        jobs.contigPaths[i] = stList_construct();
+    }
+    runInParallel(stList_length(flowers), threadNumber, getContigPathsJob, &jobs);
+
+    /*
+     * Put the paths in a canonical order and orientation, as which thread finds a path first is not deterministic.
+     */
+    stList *maximalHaplotypePaths = stList_construct3(0,
+            (void(*)(void *)) stList_destruct);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        for (int64_t j = 0; j < stList_length(jobs.contigPaths[i]); j++) {
+            stList *contigPath = stList_get(jobs.contigPaths[i], j);
+            if (!segment_getStrand(stList_get(contigPath, 0))) {
+                int64_t length = stList_length(contigPath);
+                for (int64_t k = 0; k < (length + 1) / 2; k++) {
+                    Segment *segment = stList_get(contigPath, k);
+                    stList_set(contigPath, k, segment_getReverse(stList_get(contigPath, length - 1 - k)));
+                    stList_set(contigPath, length - 1 - k, segment_getReverse(segment));
+                }
+            }
+            stList_append(maximalHaplotypePaths, contigPath);
+        }
+        stList_destruct(jobs.contigPaths[i]);
+    }
+    stList_sort(maximalHaplotypePaths, contigPathCmpFn);
+
+    st_logDebug("We have %" PRIi64 " maximal haplotype paths\n", stList_length(
+            maximalHaplotypePaths));
+#ifndef NDEBUG
+    SegmentSet *segmentSet = segmentSet_construct();
+    for (int64_t i = 0; i < stList_length(maximalHaplotypePaths); i++) {
+        stList *contigPath = stList_get(maximalHaplotypePaths, i);
+        for (int64_t j = 0; j < stList_length(contigPath); j++) {
+            checkContigPathsCondition(segmentSet_insert(segmentSet, stList_get(contigPath, j)),
+                    "a segment is in more than one contig path");
+        }
+    }
+    checkContigPathsP(flower, maximalHaplotypePaths, segmentSet, jobs.chosenEventSet, jobs.eventSets[0]);
+    segmentSet_destruct(segmentSet);
+#endif
+
+    for (int64_t i = 0; i < threadNumber; i++) {
+        eventSet_destruct(jobs.eventSets[i]);
+    }
+    free(jobs.eventSets);
+    free(jobs.contigPaths);
+    eventSet_destruct(jobs.chosenEventSet);
+    shardedSegmentSet_destruct(jobs.segmentSet);
+    getTerminalCap_index = previousTerminalCapIndex;
+    terminalCapIndex_destruct(terminalCapIndex);
+    stList_destruct(flowers);
 
     return maximalHaplotypePaths;
 }
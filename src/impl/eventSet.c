@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "eventSet.h"
+
+struct _eventSet {
+    Name *eventNames; //Sorted, so that an event's index is its rank.
+    int64_t eventNumber;
+    stHash *endMasks; //Positively oriented ends to their cached event bitmasks.
+    stHash *blockSegments; //Positively oriented blocks to their cached EventSetBlockSegments.
+};
+
+typedef struct _eventSetBlockSegments {
+    int64_t segmentNumber;
+    Segment **segments;
+    Name *metaSequenceNames;
+} EventSetBlockSegments;
+
+static void eventSetBlockSegments_destruct(EventSetBlockSegments *blockSegments) {
+    free(blockSegments->segments);
+    free(blockSegments->metaSequenceNames);
+    free(blockSegments);
+}
+
+static int nameCmpFn(const void *a, const void *b) {
+    return cactusMisc_nameCompare(*(const Name *) a, *(const Name *) b);
+}
+
+static bool stringIsInList(const char *eventString, stList *eventStrings) {
+    for (int64_t i = 0; i < stList_length(eventStrings); i++) {
+        if (strcmp(eventString, stList_get(eventStrings, i)) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+EventSet *eventSet_construct(Flower *flower, stList *eventStrings) {
+    EventSet *eventSet = st_malloc(sizeof(EventSet));
+    EventTree *eventTree = flower_getEventTree(flower);
+    eventSet->eventNames = st_malloc(sizeof(Name) * (eventTree_getEventNumber(eventTree) + 1));
+    eventSet->eventNumber = 0;
+    EventTree_Iterator *eventIt = eventTree_getIterator(eventTree);
+    Event *event;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        if (stringIsInList(event_getHeader(event), eventStrings)) {
+            eventSet->eventNames[eventSet->eventNumber++] = event_getName(event);
+        }
+    }
+    eventTree_destructIterator(eventIt);
+    qsort(eventSet->eventNames, eventSet->eventNumber, sizeof(Name), nameCmpFn);
+    eventSet->endMasks = stHash_construct2(NULL, free);
+    eventSet->blockSegments = stHash_construct2(NULL, (void (*)(void *)) eventSetBlockSegments_destruct);
+    return eventSet;
+}
+
+EventSet *eventSet_construct2(Flower *flower, const char *eventString) {
+    stList *eventStrings = stList_construct();
+    stList_append(eventStrings, (void *) eventString);
+    EventSet *eventSet = eventSet_construct(flower, eventStrings);
+    stList_destruct(eventStrings);
+    return eventSet;
+}
+
+void eventSet_destruct(EventSet *eventSet) {
+    stHash_destruct(eventSet->endMasks);
+    stHash_destruct(eventSet->blockSegments);
+    free(eventSet->eventNames);
+    free(eventSet);
+}
+
+int64_t eventSet_size(EventSet *eventSet) {
+    return eventSet->eventNumber;
+}
+
+int64_t eventSet_getIndex(EventSet *eventSet, Event *event) {
+    Name name = event_getName(event);
+    int64_t i = 0, j = eventSet->eventNumber;
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (eventSet->eventNames[k] < name) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i < eventSet->eventNumber && eventSet->eventNames[i] == name ? i : -1;
+}
+
+bool eventSet_contains(EventSet *eventSet, Event *event) {
+    return eventSet_getIndex(eventSet, event) != -1;
+}
+
+int64_t eventSet_getMaskWordNumber(EventSet *eventSet) {
+    return (eventSet->eventNumber + 63) / 64;
+}
+
+void eventSet_getEndMask(EventSet *eventSet, End *end, uint64_t *mask) {
+    memset(mask, 0, sizeof(uint64_t) * eventSet_getMaskWordNumber(eventSet));
+    End_InstanceIterator *instanceIt = end_getInstanceIterator(end);
+    Cap *cap;
+    while ((cap = end_getNext(instanceIt)) != NULL) {
+        int64_t i = eventSet_getIndex(eventSet, cap_getEvent(cap));
+        if (i != -1) {
+            mask[i / 64] |= ((uint64_t) 1) << (i % 64);
+        }
+    }
+    end_destructInstanceIterator(instanceIt);
+}
+
+const uint64_t *eventSet_getCachedEndMask(EventSet *eventSet, End *end) {
+    end = end_getPositiveOrientation(end);
+    uint64_t *mask = stHash_search(eventSet->endMasks, end);
+    if (mask == NULL) {
+        mask = st_malloc(sizeof(uint64_t) * (eventSet_getMaskWordNumber(eventSet) + 1)); //Plus one, so that the mask is never zero length.
+        eventSet_getEndMask(eventSet, end, mask);
+        stHash_insert(eventSet->endMasks, end, mask);
+    }
+    return mask;
+}
+
+bool eventSet_maskIsNonEmpty(EventSet *eventSet, const uint64_t *mask) {
+    for (int64_t i = 0; i < eventSet_getMaskWordNumber(eventSet); i++) {
+        if (mask[i] != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void eventSet_invalidateEnd(EventSet *eventSet, End *end) {
+    uint64_t *mask = stHash_remove(eventSet->endMasks, end_getPositiveOrientation(end));
+    if (mask != NULL) {
+        free(mask);
+    }
+}
+
+typedef struct _blockSegmentEntry {
+    Name metaSequenceName;
+    Segment *segment;
+} BlockSegmentEntry;
+
+static int blockSegmentEntryCmpFn(const void *a, const void *b) {
+    return cactusMisc_nameCompare(((const BlockSegmentEntry *) a)->metaSequenceName,
+            ((const BlockSegmentEntry *) b)->metaSequenceName);
+}
+
+Segment **eventSet_getCachedBlockSegments(EventSet *eventSet, Block *block, const Name **metaSequenceNames,
+        int64_t *segmentNumber) {
+    block = block_getPositiveOrientation(block);
+    EventSetBlockSegments *blockSegments = stHash_search(eventSet->blockSegments, block);
+    if (blockSegments == NULL) {
+        BlockSegmentEntry *entries = st_malloc(sizeof(BlockSegmentEntry) * (block_getInstanceNumber(block) + 1));
+        int64_t j = 0;
+        Block_InstanceIterator *instanceIt = block_getInstanceIterator(block);
+        Segment *segment;
+        while ((segment = block_getNext(instanceIt)) != NULL) {
+            if (eventSet_contains(eventSet, segment_getEvent(segment))) {
+                Sequence *sequence = segment_getSequence(segment);
+                entries[j].metaSequenceName = sequence != NULL ? metaSequence_getName(sequence_getMetaSequence(sequence))
+                        : NULL_NAME;
+                entries[j++].segment = segment;
+            }
+        }
+        block_destructInstanceIterator(instanceIt);
+        qsort(entries, j, sizeof(BlockSegmentEntry), blockSegmentEntryCmpFn);
+        blockSegments = st_malloc(sizeof(EventSetBlockSegments));
+        blockSegments->segmentNumber = j;
+        blockSegments->segments = st_malloc(sizeof(Segment *) * (j + 1));
+        blockSegments->metaSequenceNames = st_malloc(sizeof(Name) * (j + 1));
+        for (int64_t i = 0; i < j; i++) {
+            blockSegments->segments[i] = entries[i].segment;
+            blockSegments->metaSequenceNames[i] = entries[i].metaSequenceName;
+        }
+        free(entries);
+        stHash_insert(eventSet->blockSegments, block, blockSegments);
+    }
+    *metaSequenceNames = blockSegments->metaSequenceNames;
+    *segmentNumber = blockSegments->segmentNumber;
+    return blockSegments->segments;
+}
+
+void eventSet_clearCache(EventSet *eventSet) {
+    stHash_destruct(eventSet->endMasks);
+    eventSet->endMasks = stHash_construct2(NULL, free);
+    stHash_destruct(eventSet->blockSegments);
+    eventSet->blockSegments = stHash_construct2(NULL, (void (*)(void *)) eventSetBlockSegments_destruct);
+}
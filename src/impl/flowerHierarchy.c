@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "parallel.h"
+#include "flowerHierarchy.h"
+
+static void getNestedFlowersP(Flower *flower, stList *flowers) {
+    stList_append(flowers, flower);
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        if (group_getNestedFlower(group) != NULL) {
+            getNestedFlowersP(group_getNestedFlower(group), flowers);
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+
+stList *getNestedFlowers(Flower *flower) {
+    stList *flowers = stList_construct();
+    getNestedFlowersP(flower, flowers);
+    return flowers;
+}
+
+typedef struct _flowerWalkJobs {
+    stList *flowers;
+    void (*visitFn)(Flower *nestedFlower, stList *results, void *extraArg);
+    void *extraArg;
+    stList **threadResults;
+} FlowerWalkJobs;
+
+static void flowerWalkJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    FlowerWalkJobs *jobs = extraArg;
+    jobs->visitFn(stList_get(jobs->flowers, jobIndex), jobs->threadResults[threadIndex], jobs->extraArg);
+}
+
+stList *getFromNestedFlowersInParallel(Flower *flower,
+        void (*visitFn)(Flower *nestedFlower, stList *results, void *extraArg), void *extraArg, int64_t threadNumber) {
+    if (threadNumber < 1) {
+        threadNumber = 1;
+    }
+    FlowerWalkJobs jobs;
+    jobs.flowers = getNestedFlowers(flower);
+    jobs.visitFn = visitFn;
+    jobs.extraArg = extraArg;
+    jobs.threadResults = st_malloc(sizeof(stList *) * threadNumber);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        jobs.threadResults[i] = stList_construct();
+    }
+    runInParallel(stList_length(jobs.flowers), threadNumber, flowerWalkJob, &jobs);
+    stList *results = jobs.threadResults[0];
+    for (int64_t i = 1; i < threadNumber; i++) {
+        stList_appendAll(results, jobs.threadResults[i]);
+        stList_destruct(jobs.threadResults[i]);
+    }
+    free(jobs.threadResults);
+    stList_destruct(jobs.flowers);
+    return results;
+}
+
+static void getSegments(Flower *flower, stList *segments, void *extraArg) {
+    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
+    Segment *segment;
+    while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
+        stList_append(segments, segment_getStrand(segment) ? segment : segment_getReverse(segment));
+    }
+    flower_destructSegmentIterator(segmentIt);
+}
+
+stList *getNestedSegmentsInParallel(Flower *flower, int64_t threadNumber) {
+    return getFromNestedFlowersInParallel(flower, getSegments, NULL, threadNumber);
+}
@@ -6,141 +6,117 @@
 
 #include "sonLib.h"
 #include "cactus.h"
+#include "eventSet.h"
 #include "adjacencyTraversal.h"
+#include "parallel.h"
+#include "flowerHierarchy.h"
+#include "segmentIndex.h"
+#include "linkage.h"
 
-static bool stringIsInList(const char *eventString, stList *eventStrings) {
-    for (int64_t i = 0; i < stList_length(eventStrings); i++) {
-        const char *eventString2 = stList_get(eventStrings, i);
-        if (strcmp(eventString, eventString2) == 0) {
-            return 0;
-        }
+static void *getArray(stList *list) {
+    /*
+     * Copies the list into an array for sorting, and frees the list.
+     */
+    void **array = st_malloc(sizeof(void *) * (stList_length(list) + 1));
+    for (int64_t i = 0; i < stList_length(list); i++) {
+        array[i] = stList_get(list, i);
     }
-    return 1;
+    stList_destruct(list);
+    return array;
 }
 
-static void getMetaSequencesForEventsP(stSortedSet *metaSequences,
-        Flower *flower, stList *eventStrings) {
-    //Iterate over the sequences in the flower.
+static void getMetaSequencesForEventsP(Flower *flower, stList *metaSequences, void *extraArg) {
+    EventSet *eventSet = extraArg; //Only eventSet_contains is called, which does not use the caches.
     Flower_SequenceIterator *seqIt = flower_getSequenceIterator(flower);
     Sequence *sequence;
     while ((sequence = flower_getNextSequence(seqIt)) != NULL) {
-        MetaSequence *metaSequence = sequence_getMetaSequence(sequence);
-        if (stringIsInList(event_getHeader(sequence_getEvent(sequence)),
-                eventStrings) == 0) {
-            if (stSortedSet_search(metaSequences, metaSequence) == NULL) {
-                stSortedSet_insert(metaSequences, metaSequence);
-            }
+        if (eventSet_contains(eventSet, sequence_getEvent(sequence))) {
+            stList_append(metaSequences, sequence_getMetaSequence(sequence));
         }
     }
     flower_destructSequenceIterator(seqIt);
-    //Recurse over the flowers
-    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
-    Group *group;
-    while ((group = flower_getNextGroup(groupIt)) != NULL) {
-        if (group_getNestedFlower(group) != NULL) {
-            getMetaSequencesForEventsP(metaSequences,
-                    group_getNestedFlower(group), eventStrings);
-        }
-    }
-    flower_destructGroupIterator(groupIt);
 }
 
-stSortedSet *getMetaSequencesForEvents(Flower *flower, stList *eventStrings) {
+static int pointerCmpFn(const void *a, const void *b) {
+    const void *pointer1 = *(void * const *) a, *pointer2 = *(void * const *) b;
+    return pointer1 > pointer2 ? 1 : (pointer1 < pointer2 ? -1 : 0);
+}
+
+stSortedSet *getMetaSequencesForEventsInParallel(Flower *flower, stList *eventStrings, int64_t threadNumber) {
     /*
-     * Gets the haplotype sequences in the set.
+     * Gets the haplotype sequences in the set. A meta sequence is found once for each flower containing one of
+     * its sequences, so the results are sorted and duplicates removed before building the set.
      */
+    EventSet *eventSet = eventSet_construct(flower, eventStrings);
+    stList *metaSequenceList = getFromNestedFlowersInParallel(flower, getMetaSequencesForEventsP, eventSet, threadNumber);
+    int64_t metaSequenceNumber = stList_length(metaSequenceList);
+    MetaSequence **metaSequenceArray = getArray(metaSequenceList);
+    sortInParallel(metaSequenceArray, metaSequenceNumber, sizeof(MetaSequence *), pointerCmpFn, threadNumber);
     stSortedSet *metaSequences = stSortedSet_construct();
-    getMetaSequencesForEventsP(metaSequences, flower, eventStrings);
+    for (int64_t i = 0; i < metaSequenceNumber; i++) {
+        if (i == 0 || metaSequenceArray[i] != metaSequenceArray[i - 1]) {
+            stSortedSet_insert(metaSequences, metaSequenceArray[i]);
+        }
+    }
+    free(metaSequenceArray);
+    eventSet_destruct(eventSet);
     return metaSequences;
 }
 
-static void getOrderedSegmentsP(Flower *flower,
-        stSortedSet *segments) {
-    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
-    Segment *segment;
-    while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
-            if (!segment_getStrand(segment)) {
-                segment = segment_getReverse(segment);
-            }
-            assert(stSortedSet_search(segments, segment) == NULL);
-            stSortedSet_insert(segments, segment);
-    }
-    flower_destructSegmentIterator(segmentIt);
-    //Recurse over the flowers
-    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
-    Group *group;
-    while ((group = flower_getNextGroup(groupIt)) != NULL) {
-        if (group_getNestedFlower(group) != NULL) {
-            getOrderedSegmentsP(group_getNestedFlower(group),
-                    segments);
-        }
-    }
-    flower_destructGroupIterator(groupIt);
+stSortedSet *getMetaSequencesForEvents(Flower *flower, stList *eventStrings) {
+    return getMetaSequencesForEventsInParallel(flower, eventStrings, 1);
 }
 
-static int64_t segmentCompareFn_coordinate;
-static Name segmentCompareFn_metaSequence;
 static int segmentCompareFn(const void *segment1, const void *segment2) {
-    Name name1 = segment1 == &segmentCompareFn_coordinate ? segmentCompareFn_metaSequence : metaSequence_getName(sequence_getMetaSequence(segment_getSequence((Segment *)segment1)));
-
-    Name name2 = segment2 == &segmentCompareFn_coordinate ? segmentCompareFn_metaSequence : metaSequence_getName(sequence_getMetaSequence(segment_getSequence((Segment *)segment2)));
-    int i = cactusMisc_nameCompare(name1, name2);
-    if(i == 0) {
-        int64_t
-                x =
-                        segment1 == &segmentCompareFn_coordinate ? segmentCompareFn_coordinate
-                                : (int64_t) segment_getStart((void *) segment1);
-        int64_t
-                y =
-                        segment2 == &segmentCompareFn_coordinate ? segmentCompareFn_coordinate
-                                : (int64_t) segment_getStart((void *) segment2);
-        assert(
-                segment1 == &segmentCompareFn_coordinate || segment_getStrand(
-                        (void *) segment1));
-        assert(
-                segment2 == &segmentCompareFn_coordinate || segment_getStrand(
-                        (void *) segment2));
-        return x > y ? 1 : (x < y ? -1 : 0); //i > 0 ? 1 : i < 0 ? -1 : 0; //This was because of an overflow
+    assert(segment_getStrand((Segment *) segment1));
+    assert(segment_getStrand((Segment *) segment2));
+    int i = cactusMisc_nameCompare(metaSequence_getName(sequence_getMetaSequence(segment_getSequence((Segment *) segment1))),
+            metaSequence_getName(sequence_getMetaSequence(segment_getSequence((Segment *) segment2))));
+    if (i == 0) {
+        int64_t x = segment_getStart((Segment *) segment1);
+        int64_t y = segment_getStart((Segment *) segment2);
+        return x > y ? 1 : (x < y ? -1 : 0); //Compared, rather than subtracted, to avoid overflow.
     }
     return i;
 }
 
-stSortedSet *getOrderedSegments(Flower *flower) {
+static int segmentArrayCmpFn(const void *a, const void *b) {
+    return segmentCompareFn(*(Segment * const *) a, *(Segment * const *) b);
+}
+
+stSortedSet *getOrderedSegmentsInParallel(Flower *flower, int64_t threadNumber) {
+    stList *segmentList = getNestedSegmentsInParallel(flower, threadNumber);
+    int64_t segmentNumber = stList_length(segmentList);
+    Segment **segmentArray = getArray(segmentList);
+    sortInParallel(segmentArray, segmentNumber, sizeof(Segment *), segmentArrayCmpFn, threadNumber);
     stSortedSet *segments = stSortedSet_construct3(segmentCompareFn, NULL);
-    getOrderedSegmentsP(flower, segments);
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        assert(i == 0 || segmentCompareFn(segmentArray[i - 1], segmentArray[i]) < 0);
+        stSortedSet_insert(segments, segmentArray[i]);
+    }
+    free(segmentArray);
     return segments;
 }
 
-static Segment *getSegment(stSortedSet *sortedSegments, int64_t x, MetaSequence *metaSequence) {
-    segmentCompareFn_coordinate = x;
-    segmentCompareFn_metaSequence = metaSequence_getName(metaSequence);
-    Segment *segment = stSortedSet_searchLessThanOrEqual(sortedSegments,
-            &segmentCompareFn_coordinate);
-    assert((void *) segment != &segmentCompareFn_coordinate);
-
-
-    if (segment != NULL) {
-        if(sequence_getMetaSequence(segment_getSequence(segment)) == metaSequence) {
-            assert(segment_getStart(segment) <= x);
-            if (x < segment_getStart(segment) + segment_getLength(segment)) {
-                return segment;
-            }
-        }
-    }
-    return NULL;
+stSortedSet *getOrderedSegments(Flower *flower) {
+    return getOrderedSegmentsInParallel(flower, 1);
 }
 
-void pickAPairOfPointsP(MetaSequence *metaSequence, int64_t *x, int64_t *y, double proportionOfSequence) {
+static void pickAPairOfPointsP2(MetaSequence *metaSequence, int64_t *x, int64_t *y, double proportionOfSequence,
+        double random1, double random2) {
+    /*
+     * Picks the pair of points given two uniform random numbers in [0, 1), the first picking the size of the gap
+     * and the second the position of the pair.
+     */
     assert(metaSequence_getLength(metaSequence) > 20);
     assert(proportionOfSequence > 0);
     assert(proportionOfSequence <= 1.0);
     double interval = log10(metaSequence_getLength(metaSequence) * proportionOfSequence - 10);
-    double j = RANDOM();
-    double i = interval * j;
+    double i = interval * random1;
     int64_t size = (int64_t) pow(10.0, i) + 1;
     assert(size >= 1);
     assert(size < metaSequence_getLength(metaSequence));
-    *x = metaSequence_getStart(metaSequence) + RANDOM()
+    *x = metaSequence_getStart(metaSequence) + random2
             * (metaSequence_getLength(metaSequence) - size - 5);
     *y = *x + size;
     assert(*x >= 0);
@@ -150,56 +126,74 @@ void pickAPairOfPointsP(MetaSequence *metaSequence, int64_t *x, int64_t *y, doub
                     metaSequence));
 }
 
+void pickAPairOfPointsP(MetaSequence *metaSequence, int64_t *x, int64_t *y, double proportionOfSequence) {
+    double random1 = RANDOM();
+    double random2 = RANDOM();
+    pickAPairOfPointsP2(metaSequence, x, y, proportionOfSequence, random1, random2);
+}
+
 void pickAPairOfPoints(MetaSequence *metaSequence, int64_t *x, int64_t *y) {
     pickAPairOfPointsP(metaSequence, x, y, 1.0);
 }
 
-bool linked(Segment *segmentX, Segment *segmentY, int64_t difference,
-        const char *eventString, bool *aligned) {
+bool linkedInEventSet(Segment *segmentX, Segment *segmentY, int64_t difference,
+        EventSet *eventSet, bool *aligned) {
     assert(segment_getStrand(segmentX));
     assert(segment_getStrand(segmentY));
     *aligned = 0;
+    Block *blockX = segment_getBlock(segmentX);
+    const Name *metaSequenceNamesX;
+    int64_t segmentNumberX;
+    Segment **segmentsX = eventSet_getCachedBlockSegments(eventSet, blockX, &metaSequenceNamesX, &segmentNumberX);
     if (segment_getStart(segmentX) < segment_getStart(segmentY)) {
-        Block *blockX = segment_getBlock(segmentX);
         Block *blockY = segment_getBlock(segmentY);
-        Block_InstanceIterator *instanceItX = block_getInstanceIterator(blockX);
-        Segment *segmentX2;
-        while ((segmentX2 = block_getNext(instanceItX)) != NULL) {
-            if (strcmp(event_getHeader(segment_getEvent(segmentX2)),
-                    eventString) == 0) {
-                Block_InstanceIterator *instanceItY =
-                        block_getInstanceIterator(blockY);
-                Segment *segmentY2;
-                while ((segmentY2 = block_getNext(instanceItY)) != NULL) {
-                    if (strcmp(event_getHeader(segment_getEvent(segmentY2)),
-                            eventString) == 0) {
-                        *aligned = 1;
-                        if (sequence_getMetaSequence(
-                                segment_getSequence(segmentX2))
-                                == sequence_getMetaSequence(
-                                        segment_getSequence(segmentY2))) { //Have the same assembly sequence
-                            //Now check if the two segments are connected by a path of adjacency from the 3' end of segmentX to the 5' end of segmentY.
+        const Name *metaSequenceNamesY;
+        int64_t segmentNumberY;
+        Segment **segmentsY = eventSet_getCachedBlockSegments(eventSet, blockY, &metaSequenceNamesY, &segmentNumberY);
+        if (segmentNumberX == 0 || segmentNumberY == 0) {
+            return 0;
+        }
+        *aligned = 1;
+        /*
+         * The segments of each block are ordered by meta sequence, so the pairs on the same assembly sequence are found
+         * by a merge, then checked for a path of adjacency from the 3' end of segmentX to the 5' end of segmentY.
+         */
+        int64_t i = 0, j = 0;
+        while (i < segmentNumberX && j < segmentNumberY) {
+            int k = cactusMisc_nameCompare(metaSequenceNamesX[i], metaSequenceNamesY[j]);
+            if (k < 0) {
+                i++;
+            } else if (k > 0) {
+                j++;
+            } else {
+                Name metaSequenceName = metaSequenceNamesX[i];
+                int64_t iEnd = i, jEnd = j;
+                while (iEnd < segmentNumberX && metaSequenceNamesX[iEnd] == metaSequenceName) {
+                    iEnd++;
+                }
+                while (jEnd < segmentNumberY && metaSequenceNamesY[jEnd] == metaSequenceName) {
+                    jEnd++;
+                }
+                if (metaSequenceName != NULL_NAME) {
+                    for (int64_t i2 = i; i2 < iEnd; i2++) {
+                        Segment *segmentX2 = block_getOrientation(blockX) ? segmentsX[i2] : segment_getReverse(segmentsX[i2]);
+                        for (int64_t j2 = j; j2 < jEnd; j2++) {
+                            Segment *segmentY2 = block_getOrientation(blockY) ? segmentsY[j2] : segment_getReverse(segmentsY[j2]);
                             int64_t separationDistance;
-                            if (capsAreAdjacent(segment_get3Cap(segmentX2),
-                                    segment_get5Cap(segmentY2),
+                            if (capsAreAdjacent(segment_get3Cap(segmentX2), segment_get5Cap(segmentY2),
                                     &separationDistance)) {
-                                //if(difference < 10000 || (separationDistance <=  difference * 1.5 && difference <= separationDistance * 1.5)) {
-                                block_destructInstanceIterator(instanceItX);
-                                block_destructInstanceIterator(instanceItY);
                                 return 1;
-                                //}
                             }
                         }
                     }
                 }
-                block_destructInstanceIterator(instanceItY);
+                i = iEnd;
+                j = jEnd;
             }
         }
-        block_destructInstanceIterator(instanceItX);
     } else {
         assert(segmentX == segmentY);
-        if(hasCapInEvent(block_get5End(segment_getBlock(segmentX)),
-                eventString)) {
+        if (segmentNumberX > 0) { //Equivalently, the 5' end of the block has a cap in the event set.
             *aligned = 1;
             return 1;
         }
@@ -207,93 +201,867 @@ bool linked(Segment *segmentX, Segment *segmentY, int64_t difference,
     return 0;
 }
 
-static bool duplicated(Segment *segment) {
-    Sequence *sequence = segment_getSequence(segment);
-    assert(sequence != NULL);
-    MetaSequence *metaSequence = sequence_getMetaSequence(sequence);
-    Block *block = segment_getBlock(segment);
-    Block_InstanceIterator *it = block_getInstanceIterator(block);
-    Segment *segment2;
-    while((segment2 = block_getNext(it)) != NULL) {
-       if(segment != segment2) {
-           assert(segment != segment_getReverse(segment2));
-           Sequence *sequence2 = segment_getSequence(segment2);
-           if(sequence2 != NULL && sequence_getMetaSequence(sequence2) == metaSequence) {
-               block_destructInstanceIterator(it);
-               return 1;
-           }
-       }
-    }
-    block_destructInstanceIterator(it);
-    return 0;
+bool linked(Segment *segmentX, Segment *segmentY, int64_t difference,
+        const char *eventString, bool *aligned) {
+    EventSet *eventSet = eventSet_construct2(block_getFlower(segment_getBlock(segmentX)), eventString);
+    bool b = linkedInEventSet(segmentX, segmentY, difference, eventSet, aligned);
+    eventSet_destruct(eventSet);
+    return b;
 }
 
-void samplePoints(Flower *flower, MetaSequence *metaSequence,
-        const char *eventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
-        int64_t *samples, int64_t bucketNumber, double bucketSize, stSortedSet *sortedSegments,
-        bool duplication, double proportionOfSequence) {
-    if(metaSequence_getLength(metaSequence) <= 1) {
-        return;
-    }
-    for (int64_t i = 0; i < sampleNumber; i++) {
-        int64_t x, y;
-        pickAPairOfPointsP(metaSequence, &x, &y, proportionOfSequence);
-        int64_t diff = y - x;
+/*
+ * Samples are processed in batches. The pairs of points of a batch are drawn first, then the segments containing the
+ * points are found with sweeps through the segment index in coordinate order, and finally the pairs are tested for
+ * linkage in order of position, so that consecutive tests mostly touch the same or nearby blocks.
+ */
+
+#define SAMPLE_BATCH_SIZE 65536
+
+typedef struct _pointPair {
+    int64_t x;
+    int64_t y;
+    Segment *segmentX;
+    Segment *segmentY;
+} PointPair;
+
+static int pointPairCmpByX(const void *a, const void *b) {
+    const PointPair *pair1 = a, *pair2 = b;
+    return pair1->x > pair2->x ? 1 : (pair1->x < pair2->x ? -1 : (pair1->y > pair2->y ? 1 : (pair1->y < pair2->y ? -1 : 0)));
+}
+
+static int pointPairCmpByY(const void *a, const void *b) {
+    const PointPair *pair1 = a, *pair2 = b;
+    return pair1->y > pair2->y ? 1 : (pair1->y < pair2->y ? -1 : (pair1->x > pair2->x ? 1 : (pair1->x < pair2->x ? -1 : 0)));
+}
+
+static void samplePointPairs(PointPair *pairs, int64_t pairNumber, SegmentIndexCursor *cursor,
+        EventSet **eventSets, int64_t eventNumber, EventSet *otherEventSet, bool duplication,
+        int64_t *correct, int64_t *aligned, int64_t *samples, int64_t bucketNumber, double bucketSize) {
+    /*
+     * Accumulates the counts for a batch of pairs, as samplePointsForEvents does. The order of the pairs is not preserved.
+     */
+    for (int64_t i = 0; i < pairNumber; i++) {
+        int64_t diff = pairs[i].y - pairs[i].x;
         assert(diff >= 1);
         int64_t bucket = log10(diff) * bucketSize;
-        //st_uglyf("I have %" PRIi64 " %f %" PRIi64 " %" PRIi64 "\n", (int64_t)diff, bucketSize, bucket, bucketNumber);
         assert(bucket < bucketNumber);
         assert(bucket >= 0);
         samples[bucket]++;
-        Segment *segmentX = getSegment(sortedSegments, x, metaSequence);
-        if (segmentX != NULL  && (duplication || !duplicated(segmentX))) {
-            Segment *segmentY = getSegment(sortedSegments, y, metaSequence);
-            if (segmentY != NULL && (duplication || !duplicated(segmentX))) {
-                bool b;
-                if(linked(segmentX, segmentY, diff, eventString, &b)) {
-                    correct[bucket]++;
-                }
-                if(b) {
-                    aligned[bucket]++;
-                }
+    }
+    //Find the segments containing the x points, keeping the pairs with a (suitably unduplicated) segment.
+    qsort(pairs, pairNumber, sizeof(PointPair), pointPairCmpByX);
+    int64_t position = 0, j = 0;
+    for (int64_t i = 0; i < pairNumber; i++) {
+        Segment *segmentX = segmentIndexCursor_getNextSegment(cursor, pairs[i].x, &position);
+        if (segmentX == NULL || (!duplication && cursor->duplicated[position])) {
+            continue;
+        }
+        pairs[j] = pairs[i];
+        pairs[j++].segmentX = segmentX;
+    }
+    pairNumber = j;
+    //Find the segments containing the y points, keeping the pairs with a segment.
+    qsort(pairs, pairNumber, sizeof(PointPair), pointPairCmpByY);
+    position = 0;
+    j = 0;
+    for (int64_t i = 0; i < pairNumber; i++) {
+        Segment *segmentY = segmentIndexCursor_getNextSegment(cursor, pairs[i].y, &position);
+        if (segmentY != NULL) {
+            pairs[j] = pairs[i];
+            pairs[j++].segmentY = segmentY;
+        }
+    }
+    pairNumber = j;
+    //Test the pairs for linkage, against each event in turn.
+    qsort(pairs, pairNumber, sizeof(PointPair), pointPairCmpByX);
+    for (int64_t i = 0; i < pairNumber; i++) {
+        int64_t diff = pairs[i].y - pairs[i].x;
+        int64_t bucket = log10(diff) * bucketSize;
+        bool b;
+        if (otherEventSet != NULL) {
+            linkedInEventSet(pairs[i].segmentX, pairs[i].segmentY, diff, otherEventSet, &b);
+            if (!b) {
+                continue;
+            }
+        }
+        for (int64_t k = 0; k < eventNumber; k++) {
+            if (linkedInEventSet(pairs[i].segmentX, pairs[i].segmentY, diff, eventSets[k], &b)) {
+                correct[k * bucketNumber + bucket]++;
+            }
+            if (b) {
+                aligned[k * bucketNumber + bucket]++;
             }
         }
     }
 }
 
+static EventSet **constructEventSets(Flower *flower, stList *eventStrings) {
+    EventSet **eventSets = st_malloc(sizeof(EventSet *) * (stList_length(eventStrings) + 1));
+    for (int64_t i = 0; i < stList_length(eventStrings); i++) {
+        eventSets[i] = eventSet_construct2(flower, stList_get(eventStrings, i));
+    }
+    return eventSets;
+}
+
+static void destructEventSets(EventSet **eventSets, int64_t eventNumber) {
+    for (int64_t i = 0; i < eventNumber; i++) {
+        eventSet_destruct(eventSets[i]);
+    }
+    free(eventSets);
+}
+
+void samplePointsForEvents(Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence) {
+    if(metaSequence_getLength(metaSequence) <= 1) {
+        return;
+    }
+    int64_t eventNumber = stList_length(eventStrings);
+    EventSet **eventSets = constructEventSets(flower, eventStrings);
+    EventSet *otherEventSet = otherEventString != NULL ? eventSet_construct2(flower, otherEventString) : NULL;
+    SegmentIndexCursor cursor;
+    segmentIndex_initialiseCursor(segmentIndex, metaSequence, &cursor);
+    PointPair *pairs = st_malloc(sizeof(PointPair) * SAMPLE_BATCH_SIZE);
+    for (int64_t i = 0; i < sampleNumber; i += SAMPLE_BATCH_SIZE) {
+        int64_t pairNumber = sampleNumber - i < SAMPLE_BATCH_SIZE ? sampleNumber - i : SAMPLE_BATCH_SIZE;
+        for (int64_t j = 0; j < pairNumber; j++) {
+            pickAPairOfPointsP(metaSequence, &pairs[j].x, &pairs[j].y, proportionOfSequence);
+        }
+        samplePointPairs(pairs, pairNumber, &cursor, eventSets, eventNumber, otherEventSet, duplication,
+                correct, aligned, samples, bucketNumber, bucketSize);
+    }
+    free(pairs);
+    destructEventSets(eventSets, eventNumber);
+    if (otherEventSet != NULL) {
+        eventSet_destruct(otherEventSet);
+    }
+}
+
+void samplePoints(Flower *flower, MetaSequence *metaSequence,
+        const char *eventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence) {
+    stList *eventStrings = stList_construct();
+    stList_append(eventStrings, (void *) eventString);
+    samplePointsForEvents(flower, metaSequence, eventStrings, NULL, sampleNumber, correct, aligned, samples,
+            bucketNumber, bucketSize, segmentIndex, duplication, proportionOfSequence);
+    stList_destruct(eventStrings);
+}
+
 void samplePointsWithOtherReference(Flower *flower, MetaSequence *metaSequence,
         const char *eventString, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
-        int64_t *samples, int64_t bucketNumber, double bucketSize, stSortedSet *sortedSegments,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
         bool duplication, double proportionOfSequence) {
-    if(metaSequence_getLength(metaSequence) <= 1) {
+    stList *eventStrings = stList_construct();
+    stList_append(eventStrings, (void *) eventString);
+    samplePointsForEvents(flower, metaSequence, eventStrings, otherEventString, sampleNumber, correct, aligned, samples,
+            bucketNumber, bucketSize, segmentIndex, duplication, proportionOfSequence);
+    stList_destruct(eventStrings);
+}
+
+/*
+ * The parallel sampler. Each sample is drawn from its own position in a counter based random stream,
+ * so the samples, and so the result, depend only on the seed and not on how they are split between threads.
+ */
+
+static uint64_t splitMix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static double counterRandom(uint64_t seed, uint64_t counter) {
+    /*
+     * Returns the counter-th uniform random number in [0, 1) of the stream identified by the seed.
+     */
+    return (splitMix64(seed + (counter + 1) * 0x9E3779B97F4A7C15ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+typedef struct _samplePointsJobs {
+    MetaSequence *metaSequence;
+    SegmentIndex *segmentIndex;
+    int64_t eventNumber;
+    EventSet ***eventSets; //One array per thread, as event sets cache end masks and block segments.
+    EventSet **otherEventSets; //One per thread, or NULL if there is no other reference.
+    int64_t **correct; //Per thread count arrays.
+    int64_t **aligned;
+    int64_t **samples;
+    int64_t sampleNumber;
+    int64_t bucketNumber;
+    double bucketSize;
+    bool duplication;
+    double proportionOfSequence;
+    uint64_t seed;
+    int64_t firstSample;
+} SamplePointsJobs;
+
+static void samplePointsJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    SamplePointsJobs *jobs = extraArg;
+    int64_t firstSample = jobIndex * SAMPLE_BATCH_SIZE;
+    int64_t pairNumber = jobs->sampleNumber - firstSample < SAMPLE_BATCH_SIZE ? jobs->sampleNumber - firstSample : SAMPLE_BATCH_SIZE;
+    PointPair *pairs = st_malloc(sizeof(PointPair) * pairNumber);
+    for (int64_t i = 0; i < pairNumber; i++) {
+        uint64_t sample = jobs->firstSample + firstSample + i;
+        pickAPairOfPointsP2(jobs->metaSequence, &pairs[i].x, &pairs[i].y, jobs->proportionOfSequence,
+                counterRandom(jobs->seed, 2 * sample), counterRandom(jobs->seed, 2 * sample + 1));
+    }
+    SegmentIndexCursor cursor;
+    segmentIndex_initialiseCursor(jobs->segmentIndex, jobs->metaSequence, &cursor);
+    samplePointPairs(pairs, pairNumber, &cursor, jobs->eventSets[threadIndex], jobs->eventNumber,
+            jobs->otherEventSets != NULL ? jobs->otherEventSets[threadIndex] : NULL, jobs->duplication,
+            jobs->correct[threadIndex], jobs->aligned[threadIndex], jobs->samples[threadIndex],
+            jobs->bucketNumber, jobs->bucketSize);
+    free(pairs);
+}
+
+static void samplePointsForEventsInParallelP(Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t firstSample, int64_t sampleNumber, int64_t *correct,
+        int64_t *aligned, int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, uint64_t seed, int64_t threadNumber) {
+    /*
+     * Draws the samples at positions [firstSample, firstSample + sampleNumber) of the stream.
+     */
+    if (metaSequence_getLength(metaSequence) <= 1) {
         return;
     }
-    for (int64_t i = 0; i < sampleNumber; i++) {
-        int64_t x, y;
-        pickAPairOfPointsP(metaSequence, &x, &y, proportionOfSequence);
-        int64_t diff = y - x;
-        assert(diff >= 1);
-        int64_t bucket = log10(diff) * bucketSize;
-        //st_uglyf("I have %" PRIi64 " %f %" PRIi64 " %" PRIi64 "\n", (int64_t)diff, bucketSize, bucket, bucketNumber);
-        assert(bucket < bucketNumber);
-        assert(bucket >= 0);
-        samples[bucket]++;
-        Segment *segmentX = getSegment(sortedSegments, x, metaSequence);
-        if (segmentX != NULL  && (duplication || !duplicated(segmentX))) {
-            Segment *segmentY = getSegment(sortedSegments, y, metaSequence);
-            if (segmentY != NULL && (duplication || !duplicated(segmentX))) {
+    threadNumber = threadNumber < 1 ? 1 : threadNumber;
+    SamplePointsJobs jobs;
+    jobs.metaSequence = metaSequence;
+    jobs.segmentIndex = segmentIndex;
+    jobs.eventNumber = stList_length(eventStrings);
+    jobs.eventSets = st_malloc(sizeof(EventSet **) * threadNumber);
+    jobs.otherEventSets = otherEventString != NULL ? st_malloc(sizeof(EventSet *) * threadNumber) : NULL;
+    jobs.correct = st_malloc(sizeof(int64_t *) * threadNumber);
+    jobs.aligned = st_malloc(sizeof(int64_t *) * threadNumber);
+    jobs.samples = st_malloc(sizeof(int64_t *) * threadNumber);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        jobs.eventSets[i] = constructEventSets(flower, eventStrings);
+        if (jobs.otherEventSets != NULL) {
+            jobs.otherEventSets[i] = eventSet_construct2(flower, otherEventString);
+        }
+        jobs.correct[i] = st_calloc(jobs.eventNumber * bucketNumber + 1, sizeof(int64_t));
+        jobs.aligned[i] = st_calloc(jobs.eventNumber * bucketNumber + 1, sizeof(int64_t));
+        jobs.samples[i] = st_calloc(bucketNumber, sizeof(int64_t));
+    }
+    jobs.sampleNumber = sampleNumber;
+    jobs.bucketNumber = bucketNumber;
+    jobs.bucketSize = bucketSize;
+    jobs.duplication = duplication;
+    jobs.proportionOfSequence = proportionOfSequence;
+    jobs.seed = seed;
+    jobs.firstSample = firstSample;
+
+    runInParallel((sampleNumber + SAMPLE_BATCH_SIZE - 1) / SAMPLE_BATCH_SIZE, threadNumber, samplePointsJob, &jobs);
+
+    for (int64_t i = 0; i < threadNumber; i++) {
+        for (int64_t j = 0; j < jobs.eventNumber * bucketNumber; j++) {
+            correct[j] += jobs.correct[i][j];
+            aligned[j] += jobs.aligned[i][j];
+        }
+        for (int64_t j = 0; j < bucketNumber; j++) {
+            samples[j] += jobs.samples[i][j];
+        }
+        destructEventSets(jobs.eventSets[i], jobs.eventNumber);
+        if (jobs.otherEventSets != NULL) {
+            eventSet_destruct(jobs.otherEventSets[i]);
+        }
+        free(jobs.correct[i]);
+        free(jobs.aligned[i]);
+        free(jobs.samples[i]);
+    }
+    free(jobs.eventSets);
+    free(jobs.otherEventSets);
+    free(jobs.correct);
+    free(jobs.aligned);
+    free(jobs.samples);
+}
+
+void samplePointsForEventsInParallel(Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, uint64_t seed, int64_t threadNumber) {
+    samplePointsForEventsInParallelP(flower, metaSequence, eventStrings, otherEventString, 0, sampleNumber, correct, aligned,
+            samples, bucketNumber, bucketSize, segmentIndex, duplication, proportionOfSequence, seed, threadNumber);
+}
+
+void samplePointsIntoHistogram(LinkageHistogram *linkageHistogram, Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, int64_t threadNumber,
+        const char *checkpointFile, int64_t checkpointInterval) {
+    if (linkageHistogram_getEventNumber(linkageHistogram) != stList_length(eventStrings)) {
+        st_errAbort("The linkage histogram has %" PRIi64 " events, but %" PRIi64 " event strings were given",
+                linkageHistogram_getEventNumber(linkageHistogram), stList_length(eventStrings));
+    }
+    if (linkageHistogram_isMerged(linkageHistogram)) {
+        st_errAbort("Can not continue sampling into a merged linkage histogram");
+    }
+    if (checkpointInterval <= 0) {
+        checkpointInterval = INT64_MAX;
+    }
+    while (linkageHistogram_getSampleNumber(linkageHistogram) < sampleNumber) {
+        int64_t drawnSampleNumber = linkageHistogram_getSampleNumber(linkageHistogram);
+        int64_t chunkSampleNumber = sampleNumber - drawnSampleNumber < checkpointInterval ? sampleNumber - drawnSampleNumber
+                : checkpointInterval;
+        samplePointsForEventsInParallelP(flower, metaSequence, eventStrings, otherEventString,
+                linkageHistogram_getFirstSample(linkageHistogram) + drawnSampleNumber, chunkSampleNumber,
+                linkageHistogram_getCorrect(linkageHistogram), linkageHistogram_getAligned(linkageHistogram),
+                linkageHistogram_getSamples(linkageHistogram), linkageHistogram_getBucketNumber(linkageHistogram),
+                linkageHistogram_getBucketSize(linkageHistogram), segmentIndex, duplication, proportionOfSequence,
+                linkageHistogram_getSeed(linkageHistogram), threadNumber);
+        linkageHistogram_addSampleNumber(linkageHistogram, chunkSampleNumber);
+        if (checkpointFile != NULL) {
+            linkageHistogram_checkpoint(linkageHistogram, checkpointFile);
+        }
+    }
+}
+
+void samplePointsInParallel(Flower *flower, MetaSequence *metaSequence,
+        const char *eventString, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, uint64_t seed, int64_t threadNumber) {
+    stList *eventStrings = stList_construct();
+    stList_append(eventStrings, (void *) eventString);
+    samplePointsForEventsInParallel(flower, metaSequence, eventStrings, otherEventString, sampleNumber, correct, aligned,
+            samples, bucketNumber, bucketSize, segmentIndex, duplication, proportionOfSequence, seed, threadNumber);
+    stList_destruct(eventStrings);
+}
+
+/*
+ * The exact linkage engine. pickAPairOfPointsP2 picks a size d >= 2 with probability
+ * P(d) = (min(log10(d), I) - log10(d - 1)) / I, where I = log10(L * proportionOfSequence - 10) and L is the length of
+ * the meta sequence, then x uniformly from the N_d = L - d - 5 positions starting at the start of the meta sequence.
+ * So a pair of points (x, x + d) is drawn with probability w(d) = P(d) / N_d, and the expected fraction of samples
+ * in a bucket that are correct is the sum of w(d) over the linked pairs of positions whose distance d lies in the bucket.
+ *
+ * For two segments A and B the number of pairs (x, x + d) with x in A and x + d in B is a trapezoid function of d,
+ * made of three linear sections, so the contribution of a pair of segments is a few sums of w(d) * (a + b * d) over
+ * ranges of d. These are given by a model of the weights: up to EXACT_LINKAGE_NEAR_SIZE by prefix sums of w(d) and
+ * d * w(d), and beyond by pieces, each within a bucket and spanning a factor of at most 1 + EXACT_LINKAGE_PIECE_RATIO
+ * of d and of N_d, on which w(d) is replaced by the linear function with the same sum and first moment. The sums over
+ * whole pieces are thus exact, and the error of a sum over part of a piece is a small fraction of the error of linear
+ * interpolation of w(d) over the piece, which is of the order of EXACT_LINKAGE_PIECE_RATIO^2 / 8 relatively.
+ *
+ * Whether a pair of segments is aligned only depends on whether the blocks of both have segments in the event set (and
+ * in the other event set), so the aligned mass is computed from the list of the segments whose blocks do: for each
+ * piece, the segments all of whose pairs with a segment X have distances within the piece are a run of the list, summed
+ * with prefix sums of lengths and positions, and only the few segments at the ends of the run are added pair by pair.
+ * A pair can only be correct if the second segment's block has a segment downstream of a segment of the first
+ * segment's block on the same assembly sequence and strand, so the correct mass is computed from these candidates alone.
+ */
+
+#define EXACT_LINKAGE_NEAR_SIZE 4096
+#define EXACT_LINKAGE_PIECE_RATIO 0.01
+#define EXACT_LINKAGE_DIRECT_SUM_SIZE 64
+
+typedef struct _exactLinkagePiece {
+    int64_t minSize;
+    int64_t maxSize;
+    int64_t bucket;
+    long double weight; //The linear weight at minSize.
+    long double slope; //Its change per unit of size.
+} ExactLinkagePiece;
+
+typedef struct _exactLinkageModel {
+    int64_t length; //L
+    int64_t positionNumber; //L - 5, so N_d = positionNumber - d.
+    double interval; //I
+    int64_t maxSize; //The largest d with P(d) > 0.
+    int64_t nearSize; //The largest d covered by the prefix sums.
+    long double *nearWeights; //nearWeights[d] is the sum of w(t) for t <= d.
+    long double *nearSizeWeights; //nearSizeWeights[d] is the sum of t * w(t) for t <= d.
+    ExactLinkagePiece *pieces; //Covering nearSize + 1 to maxSize, in order.
+    int64_t pieceNumber;
+    int64_t *bucketFirstSizes; //bucketFirstSizes[b] is the smallest d in bucket b or greater, or maxSize + 1.
+    int64_t bucketNumber;
+    double bucketSize;
+} ExactLinkageModel;
+
+static double exactLinkageModel_getCumulativeProbability(ExactLinkageModel *model, int64_t d) {
+    /*
+     * The sum of P(t) for t <= d, which telescopes.
+     */
+    if (d <= 1) {
+        return 0.0;
+    }
+    double i = log10(d);
+    return (i < model->interval ? i : model->interval) / model->interval;
+}
+
+static int64_t exactLinkageModel_getBucket(ExactLinkageModel *model, int64_t d) {
+    int64_t bucket = log10(d) * model->bucketSize; //As computed by the samplers.
+    assert(bucket >= 0);
+    assert(bucket < model->bucketNumber);
+    return bucket;
+}
+
+static long double exactLinkageModel_getWeight(ExactLinkageModel *model, int64_t d) {
+    /*
+     * w(d), computing log10(d) - log10(d - 1) without cancellation below maxSize.
+     */
+    long double probability = d < model->maxSize ? log1pl(1.0L / (d - 1)) / (logl(10.0L) * model->interval)
+            : (fminl(log10l(d), model->interval) - log10l(d - 1)) / model->interval;
+    return probability / (model->positionNumber - d);
+}
+
+static long double exactLinkageModel_getIntegral(ExactLinkageModel *model, long double x) {
+    /*
+     * An antiderivative of w(x) for large x below maxSize, expanding log(x / (x - 1)) as the sum of 1 / (k * x^k),
+     * truncated after k = 4, and integrating each 1 / (x^k * (c - x)), c = L - 5, by partial fractions.
+     */
+    long double c = model->positionNumber, logRatio = logl(x / (c - x)), integral = 0.0;
+    for (int64_t k = 1; k <= 4; k++) {
+        long double term = logRatio / powl(c, k);
+        for (int64_t j = 2; j <= k; j++) {
+            term += powl(x, 1 - j) / ((1 - j) * powl(c, k - j + 1));
+        }
+        integral += term / k;
+    }
+    return integral / (logl(10.0L) * model->interval);
+}
+
+static long double exactLinkageModel_getWeightDerivative(ExactLinkageModel *model, long double x) {
+    long double c = model->positionNumber, scale = 1.0L / (logl(10.0L) * model->interval);
+    return -scale / (x * (x - 1.0L) * (c - x)) + scale * log1pl(1.0L / (x - 1.0L)) / ((c - x) * (c - x));
+}
+
+static void exactLinkageModel_sumWeights(ExactLinkageModel *model, int64_t minSize, int64_t maxSize,
+        long double *weight, long double *offsetWeight) {
+    /*
+     * Sets *weight to the sum of w(d) and *offsetWeight to the sum of (d - minSize) * w(d) for d in [minSize, maxSize].
+     * Long ranges far from both 0 and L - 5 are summed by Euler-Maclaurin summation, whose first omitted term
+     * is of relative size below 1e-13 there, and the others term by term.
+     */
+    if (maxSize - minSize < EXACT_LINKAGE_DIRECT_SUM_SIZE || minSize <= EXACT_LINKAGE_NEAR_SIZE
+            || model->positionNumber - maxSize <= EXACT_LINKAGE_NEAR_SIZE || maxSize >= model->maxSize) {
+        *weight = 0.0;
+        *offsetWeight = 0.0;
+        for (int64_t d = minSize; d <= maxSize; d++) {
+            long double w = exactLinkageModel_getWeight(model, d);
+            *weight += w;
+            *offsetWeight += (d - minSize) * w;
+        }
+        return;
+    }
+    *weight = exactLinkageModel_getIntegral(model, maxSize) - exactLinkageModel_getIntegral(model, minSize)
+            + (exactLinkageModel_getWeight(model, minSize) + exactLinkageModel_getWeight(model, maxSize)) / 2.0
+            + (exactLinkageModel_getWeightDerivative(model, maxSize)
+                    - exactLinkageModel_getWeightDerivative(model, minSize)) / 12.0;
+    //As (d - minSize) * w(d) = (L - 5 - minSize) * w(d) - P(d).
+    *offsetWeight = (model->positionNumber - minSize) * *weight
+            - (log10l(maxSize) - log10l(minSize - 1)) / model->interval;
+}
+
+static int64_t exactLinkageModel_getPieceEnd(ExactLinkageModel *model, int64_t d) {
+    /*
+     * The largest size of the piece starting at d. The size maxSize, whose probability is truncated, is a piece alone.
+     */
+    if (d >= model->maxSize - 1) {
+        return d;
+    }
+    int64_t n = model->positionNumber - d;
+    int64_t end = d + (int64_t) (EXACT_LINKAGE_PIECE_RATIO * (d < n ? d : n));
+    int64_t bucketEnd = model->bucketFirstSizes[exactLinkageModel_getBucket(model, d) + 1] - 1;
+    end = end < bucketEnd ? end : bucketEnd;
+    return end < model->maxSize - 1 ? end : model->maxSize - 1;
+}
+
+static ExactLinkageModel *exactLinkageModel_construct(MetaSequence *metaSequence, int64_t bucketNumber,
+        double bucketSize, double proportionOfSequence) {
+    ExactLinkageModel *model = st_malloc(sizeof(ExactLinkageModel));
+    model->length = metaSequence_getLength(metaSequence);
+    model->positionNumber = model->length - 5;
+    model->interval = log10(model->length * proportionOfSequence - 10);
+    model->bucketNumber = bucketNumber;
+    model->bucketSize = bucketSize;
+    model->maxSize = (int64_t) pow(10.0, model->interval) + 1; //Then corrected for rounding.
+    while (log10(model->maxSize) < model->interval) {
+        model->maxSize++;
+    }
+    while (model->maxSize > 2 && log10(model->maxSize - 1) >= model->interval) {
+        model->maxSize--;
+    }
+    assert(model->maxSize < model->positionNumber);
+    //The first size of each bucket, from the bucket's lower bound, corrected for rounding.
+    model->bucketFirstSizes = st_malloc(sizeof(int64_t) * (bucketNumber + 1));
+    for (int64_t b = 0; b <= bucketNumber; b++) {
+        double i = b / bucketSize;
+        int64_t d = i > log10(model->maxSize + 1) ? model->maxSize + 1 : (int64_t) pow(10.0, i);
+        d = d < 2 ? 2 : d;
+        while (d > 2 && (int64_t) (log10(d - 1) * bucketSize) >= b) {
+            d--;
+        }
+        while (d <= model->maxSize && (int64_t) (log10(d) * bucketSize) < b) {
+            d++;
+        }
+        model->bucketFirstSizes[b] = d;
+    }
+    assert(model->bucketFirstSizes[bucketNumber] == model->maxSize + 1); //Every size has a bucket.
+    model->nearSize = model->maxSize < EXACT_LINKAGE_NEAR_SIZE ? model->maxSize : EXACT_LINKAGE_NEAR_SIZE;
+    model->nearWeights = st_malloc(sizeof(long double) * (model->nearSize + 1));
+    model->nearSizeWeights = st_malloc(sizeof(long double) * (model->nearSize + 1));
+    model->nearWeights[0] = model->nearWeights[1] = 0.0;
+    model->nearSizeWeights[0] = model->nearSizeWeights[1] = 0.0;
+    for (int64_t d = 2; d <= model->nearSize; d++) {
+        long double w = exactLinkageModel_getWeight(model, d);
+        model->nearWeights[d] = model->nearWeights[d - 1] + w;
+        model->nearSizeWeights[d] = model->nearSizeWeights[d - 1] + d * w;
+    }
+    model->pieceNumber = 0;
+    for (int64_t d = model->nearSize + 1; d <= model->maxSize; d = exactLinkageModel_getPieceEnd(model, d) + 1) {
+        model->pieceNumber++;
+    }
+    model->pieces = st_malloc(sizeof(ExactLinkagePiece) * (model->pieceNumber + 1));
+    ExactLinkagePiece *piece = model->pieces;
+    for (int64_t d = model->nearSize + 1; d <= model->maxSize; d = piece->maxSize + 1, piece++) {
+        piece->minSize = d;
+        piece->maxSize = exactLinkageModel_getPieceEnd(model, d);
+        piece->bucket = exactLinkageModel_getBucket(model, d);
+        long double weight, offsetWeight;
+        exactLinkageModel_sumWeights(model, piece->minSize, piece->maxSize, &weight, &offsetWeight);
+        /*
+         * Solves for the linear weight with the same sums, the sums of 1, j and j^2 over j = d - minSize being
+         * n, s1 and s2.
+         */
+        long double n = piece->maxSize - piece->minSize + 1, s1 = n * (n - 1) / 2.0, s2 = s1 * (2 * n - 1) / 3.0;
+        piece->slope = n > 1 ? (n * offsetWeight - s1 * weight) / (n * s2 - s1 * s1) : 0.0;
+        piece->weight = (weight - piece->slope * s1) / n;
+    }
+    return model;
+}
+
+static void exactLinkageModel_destruct(ExactLinkageModel *model) {
+    free(model->nearWeights);
+    free(model->nearSizeWeights);
+    free(model->pieces);
+    free(model->bucketFirstSizes);
+    free(model);
+}
+
+static void exactLinkageModel_addSection(ExactLinkageModel *model, long double *masses, int64_t minSize,
+        int64_t maxSize, int64_t a, int64_t b) {
+    /*
+     * Adds to masses[k] the sum of w(d) * (a + b * d) for d in [minSize, maxSize] and in bucket k.
+     */
+    minSize = minSize < 2 ? 2 : minSize;
+    maxSize = maxSize > model->maxSize ? model->maxSize : maxSize;
+    for (int64_t i = minSize; i <= maxSize && i <= model->nearSize;) {
+        int64_t bucket = exactLinkageModel_getBucket(model, i);
+        int64_t j = model->bucketFirstSizes[bucket + 1] - 1;
+        j = j < maxSize ? j : maxSize;
+        j = j < model->nearSize ? j : model->nearSize;
+        masses[bucket] += a * (model->nearWeights[j] - model->nearWeights[i - 1])
+                + b * (model->nearSizeWeights[j] - model->nearSizeWeights[i - 1]);
+        i = j + 1;
+    }
+    minSize = minSize > model->nearSize ? minSize : model->nearSize + 1;
+    int64_t first = 0, last = model->pieceNumber; //Binary search for the first piece ending at or after minSize.
+    while (first < last) {
+        int64_t k = (first + last) / 2;
+        if (model->pieces[k].maxSize < minSize) {
+            first = k + 1;
+        } else {
+            last = k;
+        }
+    }
+    for (int64_t k = first; k < model->pieceNumber && model->pieces[k].minSize <= maxSize; k++) {
+        ExactLinkagePiece *piece = &model->pieces[k];
+        //Sums over j = d - piece->minSize in [j0, j1], so that the terms stay small.
+        int64_t j0 = (minSize > piece->minSize ? minSize : piece->minSize) - piece->minSize;
+        int64_t j1 = (maxSize < piece->maxSize ? maxSize : piece->maxSize) - piece->minSize;
+        long double n = j1 - j0 + 1, s1 = (long double) (j0 + j1) * n / 2.0;
+        long double s2 = ((long double) j1 * (j1 + 1) * (2 * j1 + 1) - (long double) (j0 - 1) * j0 * (2 * j0 - 1)) / 6.0;
+        long double c = a + b * piece->minSize; //The value of a + b * d at the start of the piece.
+        masses[piece->bucket] += c * (piece->weight * n + piece->slope * s1) + b * (piece->weight * s1 + piece->slope * s2);
+    }
+}
+
+static void exactLinkageModel_addSegmentPair(ExactLinkageModel *model, long double *masses, int64_t startA, int64_t endA,
+        int64_t startB, int64_t endB, int64_t minSize, int64_t maxSize) {
+    /*
+     * Adds the weights of the pairs (x, x + d) with x in [startA, endA), x + d in [startB, endB) and d in
+     * [minSize, maxSize] to masses, touching only the buckets of these sizes.
+     */
+    int64_t lengthA = endA - startA, lengthB = endB - startB;
+    if (lengthA <= 0 || lengthB <= 0) {
+        return;
+    }
+    int64_t d1 = startB - endA; //The number of pairs is d - d1 for d just above d1.
+    int64_t d3 = endB - startA; //And d3 - d for d just below d3.
+    minSize = minSize > d1 + 1 ? minSize : d1 + 1;
+    maxSize = maxSize < d3 - 1 ? maxSize : d3 - 1;
+    int64_t minLength = lengthA < lengthB ? lengthA : lengthB;
+    int64_t maxLength = lengthA < lengthB ? lengthB : lengthA;
+    exactLinkageModel_addSection(model, masses, minSize,
+            maxSize < d1 + minLength ? maxSize : d1 + minLength, -d1, 1);
+    exactLinkageModel_addSection(model, masses, minSize > d1 + minLength + 1 ? minSize : d1 + minLength + 1,
+            maxSize < d1 + maxLength ? maxSize : d1 + maxLength, minLength, 0);
+    exactLinkageModel_addSection(model, masses, minSize > d1 + maxLength + 1 ? minSize : d1 + maxLength + 1,
+            maxSize, d3, -1);
+}
+
+typedef struct _exactLinkageSegments {
+    int64_t segmentNumber;
+    Segment **segments; //The segments of the meta sequence whose blocks have segments in the event sets, in order.
+    int64_t *starts;
+    int64_t *ends; //Truncated at the end of the range of second points.
+    bool *firstPoints; //Non-zero iff the segment may hold the first point of a pair.
+    int64_t *lengthSums; //lengthSums[i] is the sum of the lengths of the segments before i.
+    int64_t *positionSums; //positionSums[i] is the sum of their positions, less origin.
+    int64_t origin;
+} ExactLinkageSegments;
+
+static void exactLinkageModel_addNearAlignedPairs(ExactLinkageModel *model, ExactLinkageSegments *segments,
+        long double *masses) {
+    /*
+     * Adds the weights of the pairs of points of the segments up to nearSize apart, pair of segments by pair of segments.
+     */
+    for (int64_t i = 0; i < segments->segmentNumber; i++) {
+        if (!segments->firstPoints[i]) {
+            continue;
+        }
+        for (int64_t j = i; j < segments->segmentNumber && segments->starts[j] - segments->ends[i] + 1 <= model->nearSize; j++) {
+            exactLinkageModel_addSegmentPair(model, masses, segments->starts[i], segments->ends[i],
+                    segments->starts[j], segments->ends[j], 2, model->nearSize);
+        }
+    }
+}
+
+static void exactLinkageModel_addFarAlignedPairs(ExactLinkageModel *model, ExactLinkageSegments *segments,
+        long double *masses) {
+    /*
+     * Adds the weights of the pairs of points of the segments more than nearSize apart, piece by piece. For a piece
+     * [p, q] and a segment X = [sX, eX), the pairs of X with a segment Y = [sY, eY) all have distances in the piece iff
+     * sY >= eX - 1 + p and eY <= sX + q + 1, and some do iff eY > sX + p and sY <= eX - 1 + q. The segments of each kind
+     * are runs of the list, whose bounds only increase with X, and the weight of the pairs of X with a run of segments
+     * of the first kind is a function of the sums of their lengths and positions.
+     */
+    int64_t n = segments->segmentNumber;
+    for (int64_t k = 0; k < model->pieceNumber; k++) {
+        ExactLinkagePiece *piece = &model->pieces[k];
+        int64_t p = piece->minSize, q = piece->maxSize;
+        int64_t first = 0, firstInside = 0, lastInside = 0, last = 0;
+        for (int64_t i = 0; i < n; i++) {
+            if (!segments->firstPoints[i]) {
+                continue;
+            }
+            int64_t startX = segments->starts[i], endX = segments->ends[i];
+            while (first < n && segments->ends[first] <= startX + p) {
+                first++;
+            }
+            while (firstInside < n && segments->starts[firstInside] < endX - 1 + p) {
+                firstInside++;
+            }
+            while (lastInside < n && segments->ends[lastInside] <= startX + q + 1) {
+                lastInside++;
+            }
+            while (last < n && segments->starts[last] <= endX - 1 + q) {
+                last++;
+            }
+            if (firstInside < lastInside) {
+                int64_t lengthX = endX - startX;
+                int64_t lengthY = segments->lengthSums[lastInside] - segments->lengthSums[firstInside];
+                //The sum of y - startX - p over the positions y of the run, each term lying in [0, q - p + lengthX).
+                int64_t offset = segments->positionSums[lastInside] - segments->positionSums[firstInside]
+                        - lengthY * (startX - segments->origin + p);
+                masses[piece->bucket] += piece->weight * lengthX * lengthY
+                        + piece->slope * ((long double) lengthX * offset - (long double) lengthY * lengthX * (lengthX - 1) / 2.0);
+            }
+            for (int64_t j = first; j < (firstInside < last ? firstInside : last); j++) {
+                exactLinkageModel_addSegmentPair(model, masses, startX, endX, segments->starts[j], segments->ends[j], p, q);
+            }
+            for (int64_t j = firstInside > lastInside ? firstInside : lastInside; j < last; j++) {
+                exactLinkageModel_addSegmentPair(model, masses, startX, endX, segments->starts[j], segments->ends[j], p, q);
+            }
+        }
+    }
+}
+
+typedef struct _exactLinkagePlacement {
+    Name metaSequenceName; //The assembly sequence of a segment of the event set.
+    bool strand; //Its strand, oriented as the segment of the meta sequence of the same block.
+    int64_t start; //Its start on the positive strand.
+    int64_t index; //The index of that segment of the meta sequence in the list.
+} ExactLinkagePlacement;
+
+static int exactLinkagePlacementCmpFn(const void *a, const void *b) {
+    const ExactLinkagePlacement *placement1 = a, *placement2 = b;
+    int i = cactusMisc_nameCompare(placement1->metaSequenceName, placement2->metaSequenceName);
+    if (i != 0) {
+        return i;
+    }
+    if (placement1->strand != placement2->strand) {
+        return placement1->strand ? 1 : -1;
+    }
+    return placement1->start > placement2->start ? 1 : (placement1->start < placement2->start ? -1 : 0);
+}
+
+static ExactLinkagePlacement *getExactLinkagePlacements(ExactLinkageSegments *segments, EventSet *eventSet,
+        int64_t *placementNumber, int64_t **firstPlacements, int64_t **placementOrder) {
+    /*
+     * Gets the placements of the segments of the event set in the blocks of the listed segments, sorted by assembly
+     * sequence, strand and start. The sorted positions of the placements of segment i are
+     * (*placementOrder)[(*firstPlacements)[i]] to (*placementOrder)[(*firstPlacements)[i + 1] - 1].
+     */
+    *firstPlacements = st_calloc(segments->segmentNumber + 1, sizeof(int64_t));
+    for (int64_t i = 0; i < segments->segmentNumber; i++) {
+        const Name *metaSequenceNames;
+        int64_t segmentNumber;
+        eventSet_getCachedBlockSegments(eventSet, segment_getBlock(segments->segments[i]), &metaSequenceNames, &segmentNumber);
+        (*firstPlacements)[i + 1] = (*firstPlacements)[i];
+        for (int64_t j = 0; j < segmentNumber; j++) {
+            (*firstPlacements)[i + 1] += metaSequenceNames[j] != NULL_NAME;
+        }
+    }
+    *placementNumber = (*firstPlacements)[segments->segmentNumber];
+    ExactLinkagePlacement *placements = st_malloc(sizeof(ExactLinkagePlacement) * (*placementNumber + 1));
+    ExactLinkagePlacement *placement = placements;
+    for (int64_t i = 0; i < segments->segmentNumber; i++) {
+        Block *block = segment_getBlock(segments->segments[i]);
+        const Name *metaSequenceNames;
+        int64_t segmentNumber;
+        Segment **blockSegments = eventSet_getCachedBlockSegments(eventSet, block, &metaSequenceNames, &segmentNumber);
+        for (int64_t j = 0; j < segmentNumber; j++) {
+            if (metaSequenceNames[j] != NULL_NAME) {
+                //As oriented by linkedInEventSet.
+                Segment *segment = block_getOrientation(block) ? blockSegments[j] : segment_getReverse(blockSegments[j]);
+                placement->metaSequenceName = metaSequenceNames[j];
+                placement->strand = segment_getStrand(segment);
+                placement->start = segment_getStart(segment_getPositiveOrientation(segment));
+                placement->index = i;
+                placement++;
+            }
+        }
+    }
+    qsort(placements, *placementNumber, sizeof(ExactLinkagePlacement), exactLinkagePlacementCmpFn);
+    *placementOrder = st_malloc(sizeof(int64_t) * (*placementNumber + 1));
+    int64_t *placementCounts = st_calloc(segments->segmentNumber + 1, sizeof(int64_t));
+    for (int64_t k = 0; k < *placementNumber; k++) {
+        int64_t i = placements[k].index;
+        (*placementOrder)[(*firstPlacements)[i] + placementCounts[i]++] = k;
+    }
+    free(placementCounts);
+    return placements;
+}
+
+static void addExactCorrectPairs(ExactLinkageModel *model, ExactLinkageSegments *segments, EventSet *eventSet,
+        long double *masses) {
+    /*
+     * Adds the weights of the linked pairs of points of the segments. Only the pairs with a segment downstream of a
+     * placement of the first segment, on the same assembly sequence and strand, can be linked, and each such pair
+     * of segments is tested once with linkedInEventSet. A segment is linked to itself.
+     */
+    int64_t placementNumber, *firstPlacements, *placementOrder;
+    ExactLinkagePlacement *placements = getExactLinkagePlacements(segments, eventSet, &placementNumber,
+            &firstPlacements, &placementOrder);
+    int64_t *lastTested = st_malloc(sizeof(int64_t) * (segments->segmentNumber + 1)); //The last i tested with j.
+    for (int64_t j = 0; j < segments->segmentNumber; j++) {
+        lastTested[j] = -1;
+    }
+    for (int64_t i = 0; i < segments->segmentNumber; i++) {
+        if (!segments->firstPoints[i]) {
+            continue;
+        }
+        int64_t startX = segments->starts[i], endX = segments->ends[i];
+        exactLinkageModel_addSegmentPair(model, masses, startX, endX, startX, endX, 2, model->maxSize);
+        for (int64_t k = firstPlacements[i]; k < firstPlacements[i + 1]; k++) {
+            ExactLinkagePlacement *placement = &placements[placementOrder[k]];
+            int64_t step = placement->strand ? 1 : -1; //Downstream on the strand.
+            for (int64_t l = placementOrder[k] + step; l >= 0 && l < placementNumber
+                    && placements[l].metaSequenceName == placement->metaSequenceName
+                    && placements[l].strand == placement->strand; l += step) {
+                int64_t j = placements[l].index;
+                if (j <= i || lastTested[j] == i || segments->starts[j] - endX + 1 > model->maxSize) {
+                    continue;
+                }
+                lastTested[j] = i;
                 bool b;
-                linked(segmentX, segmentY, diff, otherEventString, &b);
-                if(b) {
-                    if(linked(segmentX, segmentY, diff, eventString, &b)) {
-                        correct[bucket]++;
-                    }
-                    if(b) {
-                        aligned[bucket]++;
-                    }
+                if (linkedInEventSet(segments->segments[i], segments->segments[j],
+                        segments->starts[j] - startX, eventSet, &b)) {
+                    exactLinkageModel_addSegmentPair(model, masses, startX, endX, segments->starts[j],
+                            segments->ends[j], 2, model->maxSize);
                 }
             }
         }
     }
+    free(lastTested);
+    free(placements);
+    free(firstPlacements);
+    free(placementOrder);
 }
 
+void getExactLinkage(Flower *flower, MetaSequence *metaSequence,
+        const char *eventString, const char *otherEventString, double *correct, double *aligned,
+        double *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence) {
+    if (metaSequence_getLength(metaSequence) <= 20) {
+        return;
+    }
+    ExactLinkageModel *model = exactLinkageModel_construct(metaSequence, bucketNumber, bucketSize, proportionOfSequence);
+    for (int64_t b = 0; b < bucketNumber; b++) {
+        if (model->bucketFirstSizes[b] <= model->maxSize) {
+            samples[b] += exactLinkageModel_getCumulativeProbability(model, model->bucketFirstSizes[b + 1] - 1)
+                    - exactLinkageModel_getCumulativeProbability(model, model->bucketFirstSizes[b] - 1);
+        }
+    }
+    EventSet *eventSet = eventSet_construct2(flower, eventString);
+    EventSet *otherEventSet = otherEventString != NULL ? eventSet_construct2(flower, otherEventString) : NULL;
+    SegmentIndexCursor cursor;
+    segmentIndex_initialiseCursor(segmentIndex, metaSequence, &cursor);
+    //The second point of a pair must lie before this coordinate, as x < start + N_d.
+    int64_t yEnd = metaSequence_getStart(metaSequence) + model->length - 5;
+    //List the segments whose pairs are aligned, those whose blocks have segments in both event sets.
+    ExactLinkageSegments segments;
+    int64_t n = cursor.segmentNumber;
+    segments.segments = st_malloc(sizeof(Segment *) * (n + 1));
+    segments.starts = st_malloc(sizeof(int64_t) * (n + 1));
+    segments.ends = st_malloc(sizeof(int64_t) * (n + 1));
+    segments.firstPoints = st_malloc(sizeof(bool) * (n + 1));
+    segments.lengthSums = st_malloc(sizeof(int64_t) * (n + 1));
+    segments.positionSums = st_malloc(sizeof(int64_t) * (n + 1));
+    segments.origin = metaSequence_getStart(metaSequence);
+    segments.segmentNumber = 0;
+    segments.lengthSums[0] = 0;
+    segments.positionSums[0] = 0;
+    for (int64_t i = 0; i < n && cursor.starts[i] < yEnd; i++) {
+        const Name *metaSequenceNames;
+        int64_t segmentNumber, otherSegmentNumber = 1;
+        Block *block = segment_getBlock(cursor.segments[i]);
+        eventSet_getCachedBlockSegments(eventSet, block, &metaSequenceNames, &segmentNumber);
+        if (otherEventSet != NULL) {
+            eventSet_getCachedBlockSegments(otherEventSet, block, &metaSequenceNames, &otherSegmentNumber);
+        }
+        if (segmentNumber == 0 || otherSegmentNumber == 0) {
+            continue;
+        }
+        int64_t j = segments.segmentNumber++;
+        segments.segments[j] = cursor.segments[i];
+        segments.starts[j] = cursor.starts[i];
+        segments.ends[j] = cursor.starts[i] + cursor.lengths[i] < yEnd ? cursor.starts[i] + cursor.lengths[i] : yEnd;
+        segments.firstPoints[j] = duplication || !cursor.duplicated[i];
+        int64_t length = segments.ends[j] - segments.starts[j];
+        segments.lengthSums[j + 1] = segments.lengthSums[j] + length;
+        segments.positionSums[j + 1] = segments.positionSums[j]
+                + length * (segments.starts[j] - segments.origin) + length * (length - 1) / 2;
+    }
+    long double *masses = st_calloc(2 * bucketNumber, sizeof(long double));
+    exactLinkageModel_addNearAlignedPairs(model, &segments, masses);
+    exactLinkageModel_addFarAlignedPairs(model, &segments, masses);
+    addExactCorrectPairs(model, &segments, eventSet, masses + bucketNumber);
+    for (int64_t b = 0; b < bucketNumber; b++) {
+        aligned[b] += masses[b];
+        correct[b] += masses[bucketNumber + b];
+    }
+    free(masses);
+    free(segments.segments);
+    free(segments.starts);
+    free(segments.ends);
+    free(segments.firstPoints);
+    free(segments.lengthSums);
+    free(segments.positionSums);
+    eventSet_destruct(eventSet);
+    if (otherEventSet != NULL) {
+        eventSet_destruct(otherEventSet);
+    }
+    exactLinkageModel_destruct(model);
+}
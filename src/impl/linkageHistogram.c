@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <errno.h>
+
+#include "sonLib.h"
+#include "linkageHistogram.h"
+
+static const char linkageHistogram_magic[8] = { 'L', 'N', 'K', 'H', 'I', 'S', 'T', '2' };
+static const char linkageHistogram_magic1[8] = { 'L', 'N', 'K', 'H', 'I', 'S', 'T', '1' }; //Written before histograms could be merged.
+
+/*
+ * The samples of stream positions [firstSample, firstSample + sampleNumber) of the stream identified by the seed.
+ */
+typedef struct _sampleRange {
+    uint64_t seed;
+    int64_t firstSample;
+    int64_t sampleNumber;
+} SampleRange;
+
+struct _linkageHistogram {
+    int64_t eventNumber;
+    int64_t bucketNumber;
+    double bucketSize;
+    uint64_t seed;
+    int64_t firstSample;
+    int64_t sampleNumber;
+    int64_t *correct;
+    int64_t *aligned;
+    int64_t *samples;
+    bool merged;
+    int64_t rangeNumber; //The sample ranges of a merged histogram, rangeNumber is zero until merged.
+    SampleRange *ranges;
+};
+
+LinkageHistogram *linkageHistogram_construct(int64_t eventNumber, int64_t bucketNumber, double bucketSize,
+        uint64_t seed, int64_t firstSample) {
+    assert(eventNumber >= 0);
+    assert(bucketNumber >= 0);
+    LinkageHistogram *linkageHistogram = st_malloc(sizeof(LinkageHistogram));
+    linkageHistogram->eventNumber = eventNumber;
+    linkageHistogram->bucketNumber = bucketNumber;
+    linkageHistogram->bucketSize = bucketSize;
+    linkageHistogram->seed = seed;
+    linkageHistogram->firstSample = firstSample;
+    linkageHistogram->sampleNumber = 0;
+    linkageHistogram->correct = st_calloc(eventNumber * bucketNumber + 1, sizeof(int64_t));
+    linkageHistogram->aligned = st_calloc(eventNumber * bucketNumber + 1, sizeof(int64_t));
+    linkageHistogram->samples = st_calloc(bucketNumber + 1, sizeof(int64_t));
+    linkageHistogram->merged = 0;
+    linkageHistogram->rangeNumber = 0;
+    linkageHistogram->ranges = NULL;
+    return linkageHistogram;
+}
+
+void linkageHistogram_destruct(LinkageHistogram *linkageHistogram) {
+    free(linkageHistogram->correct);
+    free(linkageHistogram->aligned);
+    free(linkageHistogram->samples);
+    free(linkageHistogram->ranges);
+    free(linkageHistogram);
+}
+
+int64_t linkageHistogram_getEventNumber(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->eventNumber;
+}
+
+int64_t linkageHistogram_getBucketNumber(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->bucketNumber;
+}
+
+double linkageHistogram_getBucketSize(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->bucketSize;
+}
+
+uint64_t linkageHistogram_getSeed(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->seed;
+}
+
+int64_t linkageHistogram_getFirstSample(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->firstSample;
+}
+
+int64_t linkageHistogram_getSampleNumber(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->sampleNumber;
+}
+
+bool linkageHistogram_isMerged(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->merged;
+}
+
+void linkageHistogram_addSampleNumber(LinkageHistogram *linkageHistogram, int64_t sampleNumber) {
+    if (linkageHistogram->merged) {
+        st_errAbort("Can not add samples to a merged linkage histogram");
+    }
+    linkageHistogram->sampleNumber += sampleNumber;
+}
+
+int64_t *linkageHistogram_getCorrect(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->correct;
+}
+
+int64_t *linkageHistogram_getAligned(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->aligned;
+}
+
+int64_t *linkageHistogram_getSamples(LinkageHistogram *linkageHistogram) {
+    return linkageHistogram->samples;
+}
+
+static SampleRange *getSampleRanges(LinkageHistogram *linkageHistogram, SampleRange *range, int64_t *rangeNumber) {
+    /*
+     * Returns the sample ranges of the histogram. For a histogram that has not been merged this is its own range,
+     * which is written to the given range.
+     */
+    if (linkageHistogram->merged) {
+        *rangeNumber = linkageHistogram->rangeNumber;
+        return linkageHistogram->ranges;
+    }
+    range->seed = linkageHistogram->seed;
+    range->firstSample = linkageHistogram->firstSample;
+    range->sampleNumber = linkageHistogram->sampleNumber;
+    *rangeNumber = 1;
+    return range;
+}
+
+void linkageHistogram_merge(LinkageHistogram *linkageHistogram, LinkageHistogram *linkageHistogram2) {
+    if (linkageHistogram->eventNumber != linkageHistogram2->eventNumber
+            || linkageHistogram->bucketNumber != linkageHistogram2->bucketNumber
+            || linkageHistogram->bucketSize != linkageHistogram2->bucketSize) {
+        st_errAbort("Can not merge linkage histograms with different events or buckets");
+    }
+    SampleRange range, range2;
+    int64_t rangeNumber2;
+    SampleRange *ranges2 = getSampleRanges(linkageHistogram2, &range2, &rangeNumber2);
+    int64_t rangeNumber;
+    SampleRange *ranges = getSampleRanges(linkageHistogram, &range, &rangeNumber);
+    for (int64_t i = 0; i < rangeNumber; i++) {
+        for (int64_t j = 0; j < rangeNumber2; j++) {
+            if (ranges[i].seed == ranges2[j].seed && ranges[i].firstSample < ranges2[j].firstSample + ranges2[j].sampleNumber
+                    && ranges2[j].firstSample < ranges[i].firstSample + ranges[i].sampleNumber) {
+                st_errAbort("Can not merge linkage histograms with overlapping samples, of seed %" PRIu64 "", ranges[i].seed);
+            }
+        }
+    }
+    SampleRange *mergedRanges = st_malloc(sizeof(SampleRange) * (rangeNumber + rangeNumber2));
+    memcpy(mergedRanges, ranges, sizeof(SampleRange) * rangeNumber);
+    memcpy(mergedRanges + rangeNumber, ranges2, sizeof(SampleRange) * rangeNumber2);
+    free(linkageHistogram->ranges);
+    linkageHistogram->ranges = mergedRanges;
+    linkageHistogram->rangeNumber = rangeNumber + rangeNumber2;
+    linkageHistogram->merged = 1;
+
+    for (int64_t i = 0; i < linkageHistogram->eventNumber * linkageHistogram->bucketNumber; i++) {
+        linkageHistogram->correct[i] += linkageHistogram2->correct[i];
+        linkageHistogram->aligned[i] += linkageHistogram2->aligned[i];
+    }
+    for (int64_t i = 0; i < linkageHistogram->bucketNumber; i++) {
+        linkageHistogram->samples[i] += linkageHistogram2->samples[i];
+    }
+    linkageHistogram->sampleNumber += linkageHistogram2->sampleNumber;
+}
+
+static void writeBytes(const void *bytes, size_t size, FILE *fileHandle) {
+    if (size > 0 && fwrite(bytes, 1, size, fileHandle) != size) {
+        st_errAbort("Failed to write the linkage histogram");
+    }
+}
+
+static void readBytes(void *bytes, size_t size, FILE *fileHandle) {
+    if (size > 0 && fread(bytes, 1, size, fileHandle) != size) {
+        st_errAbort("Truncated linkage histogram");
+    }
+}
+
+void linkageHistogram_write(LinkageHistogram *linkageHistogram, FILE *fileHandle) {
+    writeBytes(linkageHistogram_magic, sizeof(linkageHistogram_magic), fileHandle);
+    writeBytes(&linkageHistogram->eventNumber, sizeof(int64_t), fileHandle);
+    writeBytes(&linkageHistogram->bucketNumber, sizeof(int64_t), fileHandle);
+    writeBytes(&linkageHistogram->bucketSize, sizeof(double), fileHandle);
+    writeBytes(&linkageHistogram->seed, sizeof(uint64_t), fileHandle);
+    writeBytes(&linkageHistogram->firstSample, sizeof(int64_t), fileHandle);
+    writeBytes(&linkageHistogram->sampleNumber, sizeof(int64_t), fileHandle);
+    int64_t cellNumber = linkageHistogram->eventNumber * linkageHistogram->bucketNumber;
+    writeBytes(linkageHistogram->correct, sizeof(int64_t) * cellNumber, fileHandle);
+    writeBytes(linkageHistogram->aligned, sizeof(int64_t) * cellNumber, fileHandle);
+    writeBytes(linkageHistogram->samples, sizeof(int64_t) * linkageHistogram->bucketNumber, fileHandle);
+    int64_t merged = linkageHistogram->merged;
+    writeBytes(&merged, sizeof(int64_t), fileHandle);
+    writeBytes(&linkageHistogram->rangeNumber, sizeof(int64_t), fileHandle);
+    writeBytes(linkageHistogram->ranges, sizeof(SampleRange) * linkageHistogram->rangeNumber, fileHandle);
+}
+
+LinkageHistogram *linkageHistogram_load(FILE *fileHandle) {
+    char magic[sizeof(linkageHistogram_magic)];
+    if (fread(magic, 1, sizeof(magic), fileHandle) != sizeof(magic)
+            || (memcmp(magic, linkageHistogram_magic, sizeof(magic)) != 0
+                    && memcmp(magic, linkageHistogram_magic1, sizeof(magic)) != 0)) {
+        st_errAbort("Not a linkage histogram");
+    }
+    int64_t eventNumber, bucketNumber, firstSample, sampleNumber;
+    double bucketSize;
+    uint64_t seed;
+    readBytes(&eventNumber, sizeof(int64_t), fileHandle);
+    readBytes(&bucketNumber, sizeof(int64_t), fileHandle);
+    readBytes(&bucketSize, sizeof(double), fileHandle);
+    readBytes(&seed, sizeof(uint64_t), fileHandle);
+    readBytes(&firstSample, sizeof(int64_t), fileHandle);
+    readBytes(&sampleNumber, sizeof(int64_t), fileHandle);
+    if (eventNumber < 0 || bucketNumber < 0 || sampleNumber < 0) {
+        st_errAbort("Corrupt linkage histogram");
+    }
+    LinkageHistogram *linkageHistogram = linkageHistogram_construct(eventNumber, bucketNumber, bucketSize, seed, firstSample);
+    linkageHistogram->sampleNumber = sampleNumber;
+    readBytes(linkageHistogram->correct, sizeof(int64_t) * eventNumber * bucketNumber, fileHandle);
+    readBytes(linkageHistogram->aligned, sizeof(int64_t) * eventNumber * bucketNumber, fileHandle);
+    readBytes(linkageHistogram->samples, sizeof(int64_t) * bucketNumber, fileHandle);
+    if (memcmp(magic, linkageHistogram_magic, sizeof(magic)) == 0) {
+        int64_t merged, rangeNumber;
+        readBytes(&merged, sizeof(int64_t), fileHandle);
+        readBytes(&rangeNumber, sizeof(int64_t), fileHandle);
+        if ((merged != 0 && merged != 1) || rangeNumber < 0 || (merged == 0 && rangeNumber != 0)) {
+            st_errAbort("Corrupt linkage histogram");
+        }
+        linkageHistogram->merged = merged;
+        linkageHistogram->rangeNumber = rangeNumber;
+        linkageHistogram->ranges = st_malloc(sizeof(SampleRange) * (rangeNumber + 1));
+        readBytes(linkageHistogram->ranges, sizeof(SampleRange) * rangeNumber, fileHandle);
+    }
+    return linkageHistogram;
+}
+
+void linkageHistogram_checkpoint(LinkageHistogram *linkageHistogram, const char *fileName) {
+    char *tempFileName = stString_print("%s.tmp", fileName);
+    FILE *fileHandle = fopen(tempFileName, "wb");
+    if (fileHandle == NULL) {
+        st_errAbort("Failed to open the linkage histogram checkpoint file: %s", tempFileName);
+    }
+    linkageHistogram_write(linkageHistogram, fileHandle);
+    if (fclose(fileHandle) != 0 || rename(tempFileName, fileName) != 0) {
+        st_errAbort("Failed to write the linkage histogram checkpoint file: %s", fileName);
+    }
+    free(tempFileName);
+}
+
+LinkageHistogram *linkageHistogram_loadCheckpoint(const char *fileName) {
+    FILE *fileHandle = fopen(fileName, "rb");
+    if (fileHandle == NULL) {
+        if (errno == ENOENT) {
+            return NULL;
+        }
+        st_errAbort("Failed to open the linkage histogram checkpoint file: %s", fileName);
+    }
+    LinkageHistogram *linkageHistogram = linkageHistogram_load(fileHandle);
+    fclose(fileHandle);
+    return linkageHistogram;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "nCount.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define N_COUNT_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Setting bit 0x20 maps 'N' to 'n' and maps no other character to 'n'.
+ */
+static int64_t countNsScalar(const char *string, int64_t length) {
+    int64_t j = 0;
+    for (int64_t i = 0; i < length; i++) {
+        j += (string[i] | 0x20) == 'n';
+    }
+    return j;
+}
+
+#ifdef N_COUNT_X86
+
+/*
+ * The vector kernels accumulate per byte counts (as the negation of the all ones compare result),
+ * emptying the accumulator with a sum of absolute differences before any byte can overflow.
+ */
+
+__attribute__((target("sse2")))
+static int64_t countNsSse2(const char *string, int64_t length) {
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i n = _mm_set1_epi8('n');
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = _mm_setzero_si128();
+    int64_t i = 0;
+    while (i + 16 <= length) {
+        __m128i counts = _mm_setzero_si128();
+        for (int64_t j = 0; j < 255 && i + 16 <= length; j++, i += 16) {
+            __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *) (string + i)), caseBit);
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(v, n));
+        }
+        total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+    }
+    int64_t totals[2];
+    _mm_storeu_si128((__m128i *) totals, total);
+    return totals[0] + totals[1] + countNsScalar(string + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static int64_t countNsAvx2(const char *string, int64_t length) {
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i n = _mm256_set1_epi8('n');
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = _mm256_setzero_si256();
+    int64_t i = 0;
+    while (i + 32 <= length) {
+        __m256i counts = _mm256_setzero_si256();
+        for (int64_t j = 0; j < 255 && i + 32 <= length; j++, i += 32) {
+            __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (string + i)), caseBit);
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(v, n));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+    }
+    int64_t totals[4];
+    _mm256_storeu_si256((__m256i *) totals, total);
+    return totals[0] + totals[1] + totals[2] + totals[3] + countNsSse2(string + i, length - i);
+}
+
+#endif
+
+int64_t countNs(const char *string, int64_t length) {
+#ifdef N_COUNT_X86
+    if (length >= 32 && __builtin_cpu_supports("avx2")) {
+        return countNsAvx2(string, length);
+    }
+    if (length >= 16 && __builtin_cpu_supports("sse2")) {
+        return countNsSse2(string, length);
+    }
+#endif
+    return countNsScalar(string, length);
+}
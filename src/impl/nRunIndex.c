@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "nCount.h"
+#include "nRunIndex.h"
+
+/*
+ * The number of bases of a meta sequence fetched at a time while building the index, and the size
+ * of the blocks that are skipped without a scan when they contain no Ns.
+ */
+#define N_RUN_INDEX_CHUNK_SIZE 1048576
+#define N_RUN_INDEX_BLOCK_SIZE 4096
+
+static const char nRunIndex_magic[8] = { 'N', 'R', 'U', 'N', 'I', 'D', 'X', '1' };
+
+typedef struct _nRuns {
+    Name name; //The name of the meta sequence, also the key of the entry.
+    int64_t runNumber;
+    int64_t *starts; //Sorted, non-overlapping runs.
+    int64_t *lengths;
+    int64_t *cumulativeLengths; //cumulativeLengths[i] is the total length of the first i runs.
+} NRuns;
+
+struct _nRunIndex {
+    stHash *metaSequences;
+};
+
+static uint64_t nameHashKey(const void *name) {
+    return *(const Name *) name;
+}
+
+static int nameEqualsKey(const void *name1, const void *name2) {
+    return *(const Name *) name1 == *(const Name *) name2;
+}
+
+static void nRuns_destruct(NRuns *nRuns) {
+    free(nRuns->starts);
+    free(nRuns->lengths);
+    free(nRuns->cumulativeLengths);
+    free(nRuns);
+}
+
+static void nRuns_computeCumulativeLengths(NRuns *nRuns) {
+    nRuns->cumulativeLengths = st_malloc(sizeof(int64_t) * (nRuns->runNumber + 1));
+    nRuns->cumulativeLengths[0] = 0;
+    for (int64_t i = 0; i < nRuns->runNumber; i++) {
+        nRuns->cumulativeLengths[i + 1] = nRuns->cumulativeLengths[i] + nRuns->lengths[i];
+    }
+}
+
+NRunIndex *nRunIndex_construct(void) {
+    NRunIndex *nRunIndex = st_malloc(sizeof(NRunIndex));
+    nRunIndex->metaSequences = stHash_construct3(nameHashKey, nameEqualsKey, NULL,
+            (void (*)(void *)) nRuns_destruct);
+    return nRunIndex;
+}
+
+NRunIndex *nRunIndex_construct2(Flower *flower) {
+    NRunIndex *nRunIndex = nRunIndex_construct();
+    Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+        nRunIndex_addMetaSequence(nRunIndex, sequence_getMetaSequence(sequence));
+    }
+    flower_destructSequenceIterator(sequenceIt);
+    return nRunIndex;
+}
+
+void nRunIndex_destruct(NRunIndex *nRunIndex) {
+    stHash_destruct(nRunIndex->metaSequences);
+    free(nRunIndex);
+}
+
+static void addRun(NRuns *nRuns, int64_t *maxRunNumber, int64_t start, int64_t length) {
+    if (nRuns->runNumber > 0 && nRuns->starts[nRuns->runNumber - 1] + nRuns->lengths[nRuns->runNumber - 1] == start) {
+        nRuns->lengths[nRuns->runNumber - 1] += length; //Extends a run across a chunk boundary.
+        return;
+    }
+    if (nRuns->runNumber == *maxRunNumber) {
+        *maxRunNumber = *maxRunNumber * 2 + 16;
+        nRuns->starts = realloc(nRuns->starts, sizeof(int64_t) * *maxRunNumber);
+        nRuns->lengths = realloc(nRuns->lengths, sizeof(int64_t) * *maxRunNumber);
+        if (nRuns->starts == NULL || nRuns->lengths == NULL) {
+            st_errAbort("Failed to allocate memory for %" PRIi64 " N runs", *maxRunNumber);
+        }
+    }
+    nRuns->starts[nRuns->runNumber] = start;
+    nRuns->lengths[nRuns->runNumber++] = length;
+}
+
+void nRunIndex_addMetaSequence(NRunIndex *nRunIndex, MetaSequence *metaSequence) {
+    Name name = metaSequence_getName(metaSequence);
+    if (stHash_search(nRunIndex->metaSequences, &name) != NULL) {
+        return;
+    }
+    NRuns *nRuns = st_calloc(1, sizeof(NRuns));
+    nRuns->name = name;
+    int64_t maxRunNumber = 0;
+    int64_t metaSequenceStart = metaSequence_getStart(metaSequence);
+    int64_t metaSequenceLength = metaSequence_getLength(metaSequence);
+    for (int64_t i = 0; i < metaSequenceLength; i += N_RUN_INDEX_CHUNK_SIZE) {
+        int64_t chunkLength = metaSequenceLength - i < N_RUN_INDEX_CHUNK_SIZE ? metaSequenceLength - i : N_RUN_INDEX_CHUNK_SIZE;
+        char *string = metaSequence_getString(metaSequence, metaSequenceStart + i, chunkLength, 1);
+        for (int64_t j = 0; j < chunkLength; j += N_RUN_INDEX_BLOCK_SIZE) {
+            int64_t blockEnd = j + N_RUN_INDEX_BLOCK_SIZE < chunkLength ? j + N_RUN_INDEX_BLOCK_SIZE : chunkLength;
+            if (countNs(string + j, blockEnd - j) == 0) {
+                continue;
+            }
+            for (int64_t k = j; k < blockEnd;) {
+                if ((string[k] | 0x20) != 'n') {
+                    k++;
+                    continue;
+                }
+                int64_t runStart = k;
+                while (k < blockEnd && (string[k] | 0x20) == 'n') {
+                    k++;
+                }
+                addRun(nRuns, &maxRunNumber, metaSequenceStart + i + runStart, k - runStart);
+            }
+        }
+        free(string);
+    }
+    nRuns_computeCumulativeLengths(nRuns);
+    stHash_insert(nRunIndex->metaSequences, &nRuns->name, nRuns);
+}
+
+static int64_t nRuns_countNsBefore(NRuns *nRuns, int64_t coordinate) {
+    /*
+     * Returns the number of Ns at positions less than the coordinate.
+     */
+    int64_t i = 0, j = nRuns->runNumber; //Find the number of runs starting before the coordinate.
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (nRuns->starts[k] < coordinate) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    if (i == 0) {
+        return 0;
+    }
+    int64_t overhang = nRuns->starts[i - 1] + nRuns->lengths[i - 1] - coordinate;
+    return nRuns->cumulativeLengths[i] - (overhang > 0 ? overhang : 0);
+}
+
+int64_t nRunIndex_countNs(NRunIndex *nRunIndex, MetaSequence *metaSequence, int64_t start, int64_t length) {
+    assert(length >= 0);
+    Name name = metaSequence_getName(metaSequence);
+    NRuns *nRuns = stHash_search(nRunIndex->metaSequences, &name);
+    if (nRuns == NULL) {
+        return -1;
+    }
+    return nRuns_countNsBefore(nRuns, start + length) - nRuns_countNsBefore(nRuns, start);
+}
+
+static void writeInts(const int64_t *values, int64_t valueNumber, FILE *fileHandle) {
+    if (valueNumber > 0 && fwrite(values, sizeof(int64_t), valueNumber, fileHandle) != (size_t) valueNumber) {
+        st_errAbort("Failed to write the N run index");
+    }
+}
+
+static void readInts(int64_t *values, int64_t valueNumber, FILE *fileHandle) {
+    if (valueNumber > 0 && fread(values, sizeof(int64_t), valueNumber, fileHandle) != (size_t) valueNumber) {
+        st_errAbort("Truncated N run index");
+    }
+}
+
+void nRunIndex_write(NRunIndex *nRunIndex, FILE *fileHandle) {
+    if (fwrite(nRunIndex_magic, sizeof(char), sizeof(nRunIndex_magic), fileHandle) != sizeof(nRunIndex_magic)) {
+        st_errAbort("Failed to write the N run index");
+    }
+    int64_t metaSequenceNumber = stHash_size(nRunIndex->metaSequences);
+    writeInts(&metaSequenceNumber, 1, fileHandle);
+    stHashIterator *it = stHash_getIterator(nRunIndex->metaSequences);
+    Name *name;
+    while ((name = stHash_getNext(it)) != NULL) {
+        NRuns *nRuns = stHash_search(nRunIndex->metaSequences, name);
+        int64_t header[2] = { nRuns->name, nRuns->runNumber };
+        writeInts(header, 2, fileHandle);
+        writeInts(nRuns->starts, nRuns->runNumber, fileHandle);
+        writeInts(nRuns->lengths, nRuns->runNumber, fileHandle);
+    }
+    stHash_destructIterator(it);
+}
+
+NRunIndex *nRunIndex_load(FILE *fileHandle) {
+    char magic[sizeof(nRunIndex_magic)];
+    if (fread(magic, sizeof(char), sizeof(magic), fileHandle) != sizeof(magic)
+            || memcmp(magic, nRunIndex_magic, sizeof(magic)) != 0) {
+        st_errAbort("Not an N run index");
+    }
+    NRunIndex *nRunIndex = nRunIndex_construct();
+    int64_t metaSequenceNumber;
+    readInts(&metaSequenceNumber, 1, fileHandle);
+    for (int64_t i = 0; i < metaSequenceNumber; i++) {
+        int64_t header[2];
+        readInts(header, 2, fileHandle);
+        if (header[1] < 0) {
+            st_errAbort("Corrupt N run index");
+        }
+        NRuns *nRuns = st_calloc(1, sizeof(NRuns));
+        nRuns->name = header[0];
+        nRuns->runNumber = header[1];
+        nRuns->starts = st_malloc(sizeof(int64_t) * (nRuns->runNumber + 1));
+        nRuns->lengths = st_malloc(sizeof(int64_t) * (nRuns->runNumber + 1));
+        readInts(nRuns->starts, nRuns->runNumber, fileHandle);
+        readInts(nRuns->lengths, nRuns->runNumber, fileHandle);
+        nRuns_computeCumulativeLengths(nRuns);
+        if (stHash_search(nRunIndex->metaSequences, &nRuns->name) != NULL) {
+            st_errAbort("Corrupt N run index, duplicated meta sequence: %" PRIi64 "", nRuns->name);
+        }
+        stHash_insert(nRunIndex->metaSequences, &nRuns->name, nRuns);
+    }
+    return nRunIndex;
+}
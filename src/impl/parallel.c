@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <pthread.h>
+
+#include "sonLib.h"
+#include "parallel.h"
+
+typedef struct _parallelJobs {
+    int64_t jobNumber;
+    int64_t nextJob;
+    pthread_mutex_t mutex;
+    void (*jobFn)(int64_t jobIndex, int64_t threadIndex, void *extraArg);
+    void *extraArg;
+} ParallelJobs;
+
+typedef struct _parallelThread {
+    ParallelJobs *jobs;
+    int64_t threadIndex;
+} ParallelThread;
+
+static void *runJobs(void *arg) {
+    ParallelThread *thread = arg;
+    ParallelJobs *jobs = thread->jobs;
+    while (1) {
+        pthread_mutex_lock(&jobs->mutex);
+        int64_t jobIndex = jobs->nextJob++;
+        pthread_mutex_unlock(&jobs->mutex);
+        if (jobIndex >= jobs->jobNumber) {
+            return NULL;
+        }
+        jobs->jobFn(jobIndex, thread->threadIndex, jobs->extraArg);
+    }
+}
+
+void runInParallel(int64_t jobNumber, int64_t threadNumber,
+        void (*jobFn)(int64_t jobIndex, int64_t threadIndex, void *extraArg), void *extraArg) {
+    if (threadNumber <= 1) {
+        for (int64_t i = 0; i < jobNumber; i++) {
+            jobFn(i, 0, extraArg);
+        }
+        return;
+    }
+    ParallelJobs jobs;
+    jobs.jobNumber = jobNumber;
+    jobs.nextJob = 0;
+    jobs.jobFn = jobFn;
+    jobs.extraArg = extraArg;
+    pthread_mutex_init(&jobs.mutex, NULL);
+    pthread_t *pthreads = st_malloc(sizeof(pthread_t) * threadNumber);
+    ParallelThread *threads = st_malloc(sizeof(ParallelThread) * threadNumber);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        threads[i].jobs = &jobs;
+        threads[i].threadIndex = i;
+        if (pthread_create(&pthreads[i], NULL, runJobs, &threads[i]) != 0) {
+            st_errAbort("Failed to create thread %" PRIi64 " of %" PRIi64 "\n", i, threadNumber);
+        }
+    }
+    for (int64_t i = 0; i < threadNumber; i++) {
+        pthread_join(pthreads[i], NULL);
+    }
+    pthread_mutex_destroy(&jobs.mutex);
+    free(pthreads);
+    free(threads);
+}
+
+typedef struct _parallelSort {
+    char *base;
+    char *buffer;
+    int64_t elementNumber;
+    size_t elementSize;
+    int (*cmpFn)(const void *, const void *);
+    int64_t runLength;
+} ParallelSort;
+
+static void sortRunJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    ParallelSort *parallelSort = extraArg;
+    int64_t start = jobIndex * parallelSort->runLength;
+    int64_t end = start + parallelSort->runLength < parallelSort->elementNumber ? start + parallelSort->runLength
+            : parallelSort->elementNumber;
+    qsort(parallelSort->base + start * parallelSort->elementSize, end - start, parallelSort->elementSize,
+            parallelSort->cmpFn);
+}
+
+static void mergeRunsJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    /*
+     * Merges the two adjacent sorted runs starting at 2 * jobIndex * runLength from the base into the buffer.
+     */
+    ParallelSort *parallelSort = extraArg;
+    size_t elementSize = parallelSort->elementSize;
+    int64_t i = 2 * jobIndex * parallelSort->runLength;
+    int64_t middle = i + parallelSort->runLength < parallelSort->elementNumber ? i + parallelSort->runLength
+            : parallelSort->elementNumber;
+    int64_t end = middle + parallelSort->runLength < parallelSort->elementNumber ? middle + parallelSort->runLength
+            : parallelSort->elementNumber;
+    int64_t j = middle, k = i;
+    while (i < middle && j < end) {
+        if (parallelSort->cmpFn(parallelSort->base + j * elementSize, parallelSort->base + i * elementSize) < 0) {
+            memcpy(parallelSort->buffer + k++ * elementSize, parallelSort->base + j++ * elementSize, elementSize);
+        } else {
+            memcpy(parallelSort->buffer + k++ * elementSize, parallelSort->base + i++ * elementSize, elementSize);
+        }
+    }
+    memcpy(parallelSort->buffer + k * elementSize, parallelSort->base + i * elementSize, (middle - i) * elementSize);
+    k += middle - i;
+    memcpy(parallelSort->buffer + k * elementSize, parallelSort->base + j * elementSize, (end - j) * elementSize);
+}
+
+void sortInParallel(void *base, int64_t elementNumber, size_t elementSize,
+        int (*cmpFn)(const void *, const void *), int64_t threadNumber) {
+    if (threadNumber <= 1 || elementNumber < 2 * threadNumber) {
+        qsort(base, elementNumber, elementSize, cmpFn);
+        return;
+    }
+    ParallelSort parallelSort;
+    parallelSort.base = base;
+    parallelSort.buffer = st_malloc(elementNumber * elementSize);
+    parallelSort.elementNumber = elementNumber;
+    parallelSort.elementSize = elementSize;
+    parallelSort.cmpFn = cmpFn;
+    parallelSort.runLength = (elementNumber + threadNumber - 1) / threadNumber;
+    runInParallel((elementNumber + parallelSort.runLength - 1) / parallelSort.runLength, threadNumber, sortRunJob,
+            &parallelSort);
+    while (parallelSort.runLength < elementNumber) {
+        runInParallel((elementNumber + 2 * parallelSort.runLength - 1) / (2 * parallelSort.runLength), threadNumber,
+                mergeRunsJob, &parallelSort);
+        char *swap = parallelSort.base; //The merged runs are in the buffer, so swap the two.
+        parallelSort.base = parallelSort.buffer;
+        parallelSort.buffer = swap;
+        parallelSort.runLength *= 2;
+    }
+    if (parallelSort.base != base) {
+        memcpy(base, parallelSort.base, elementNumber * elementSize);
+        parallelSort.buffer = parallelSort.base;
+    }
+    free(parallelSort.buffer);
+}
@@ -5,6 +5,7 @@
  */
 
 #include "cactus.h"
+#include "eventSet.h"
 #include "contigPaths.h"
 #include "adjacencyTraversal.h"
 #include "adjacencyClassification.h"
@@ -23,18 +24,34 @@ SequenceInterval *sequenceInterval_construct(int64_t start, int64_t end,
     sequenceInterval->end = end;
     assert(sequenceName != NULL);
     sequenceInterval->sequenceName = stString_copy(sequenceName);
+    sequenceInterval->ownsSequenceName = 1;
+    return sequenceInterval;
+}
+
+SequenceInterval *sequenceInterval_construct2(int64_t start, int64_t end,
+        const char *sequenceName) {
+    SequenceInterval *sequenceInterval = st_malloc(sizeof(SequenceInterval));
+    assert(end >= start);
+    assert(start >= 0);
+    sequenceInterval->start = start;
+    sequenceInterval->end = end;
+    assert(sequenceName != NULL);
+    sequenceInterval->sequenceName = sequenceName;
+    sequenceInterval->ownsSequenceName = 0;
     return sequenceInterval;
 }
 
 void sequenceInterval_destruct(SequenceInterval *sequenceInterval) {
-    free(sequenceInterval->sequenceName);
+    if (sequenceInterval->ownsSequenceName) {
+        free((char *) sequenceInterval->sequenceName);
+    }
     free(sequenceInterval);
 }
 
-static void addInterval(Segment *_5Segment, Segment *_3Segment,
-        stList *intervals) {
+static Sequence *getInterval(Segment *_5Segment, Segment *_3Segment, int64_t *start, int64_t *end) {
     /*
-     * Add an interval to the list of inserval.
+     * Gets the interval of the sequence spanned by the path from the 5' segment to the 3' segment, relative to
+     * the start of the sequence, and returns the sequence.
      */
     assert(segment_getStrand(_5Segment) == segment_getStrand(_3Segment));
     if (!segment_getStrand(_5Segment)) {
@@ -54,12 +71,20 @@ static void addInterval(Segment *_5Segment, Segment *_3Segment,
             segment_getStart(_5Segment) < segment_getStart(_3Segment)
                     + segment_getLength(_3Segment));
 
+    *start = segment_getStart(_5Segment) - sequence_getStart(sequence);
+    *end = segment_getStart(_3Segment) + segment_getLength(_3Segment) - sequence_getStart(sequence);
+    return sequence;
+}
+
+static void addInterval(Segment *_5Segment, Segment *_3Segment,
+        stList *intervals) {
+    /*
+     * Add an interval to the list of inserval.
+     */
+    int64_t start, end;
+    Sequence *sequence = getInterval(_5Segment, _3Segment, &start, &end);
     SequenceInterval *sequenceInterval =
-            sequenceInterval_construct(
-                    segment_getStart(_5Segment) - sequence_getStart(sequence),
-                    segment_getStart(_3Segment) + segment_getLength(_3Segment)
-                            - sequence_getStart(sequence),
-                    sequence_getHeader(sequence));
+            sequenceInterval_construct2(start, end, sequence_getHeader(sequence));
     stList_append(intervals, sequenceInterval);
     st_logDebug("Built a path interval %s %" PRIi64 " %" PRIi64 "\n",
             sequenceInterval->sequenceName, sequenceInterval->start,
@@ -117,36 +142,27 @@ int segmentAndPosition_cmpFn(SegmentAndPosition *a, SegmentAndPosition *b) {
 
 static int64_t getSplitContigPathIntervalsP(Segment *segment,
         stList *contigPath, stSortedSet *seen, int64_t i) {
-    addToSet(seen, segment, i);
-    //st_uglyf("Gooo %lli %" PRIi64 " %" PRIi64 " %s %" PRIi64 " %" PRIi64 "\n", segment_getName(segment), segment_getStart(segment), segment_getLength(segment), sequence_getHeader(segment_getSequence(segment)), i, stList_length(contigPath));
-    assert(
-            segment_getBlock(segment) == segment_getBlock(
-                    stList_get(contigPath, i)));
-    if (i + 1 < stList_length(contigPath)) {
+    while (1) {
+        addToSet(seen, segment, i);
+        assert(
+                segment_getBlock(segment) == segment_getBlock(
+                        stList_get(contigPath, i)));
+        if (i + 1 >= stList_length(contigPath)) {
+            return i;
+        }
         Segment *segment2 = getAdjacentCapsSegment(segment_get3Cap(segment));
         if (segment2 != NULL) {
-            //st_uglyf("Gooo2 %lli %" PRIi64 " %" PRIi64 " %s\n", segment_getName(segment2), segment_getStart(segment2), segment_getLength(segment2), sequence_getHeader(segment_getSequence(segment2)));
             assert(segment_getStrand(segment2) == segment_getStrand(segment));
             assert(getAdjacentCapsSegment(segment_get5Cap(segment2)) == segment);
             assert(!isInSet(seen, segment2, i+1));
         }
-        return segment2 != NULL && segment_getBlock(segment2)
-                == segment_getBlock(stList_get(contigPath, i + 1)) ? getSplitContigPathIntervalsP(
-                segment2, contigPath, seen, i + 1)
-                : i;
-    } else {
-        return i;
-    }
-}
-
-static bool segmentIsInEvents(Segment *segment, stList *eventStrings) {
-    for (int64_t i = 0; i < stList_length(eventStrings); i++) {
-        if (strcmp(event_getHeader(segment_getEvent(segment)),
-                stList_get(eventStrings, i)) == 0) {
-            return 1;
+        if (segment2 == NULL || segment_getBlock(segment2)
+                != segment_getBlock(stList_get(contigPath, i + 1))) {
+            return i;
         }
+        segment = segment2;
+        i++;
     }
-    return 0;
 }
 
 stList *getSplitContigPathIntervals(Flower *flower, stList *contigPaths,
@@ -156,10 +172,13 @@ stList *getSplitContigPathIntervals(Flower *flower, stList *contigPaths,
             stList_length(contigPaths));
     stList *intervals = stList_construct3(0,
             (void(*)(void *)) sequenceInterval_destruct);
+    EventSet *eventSet = eventSet_construct(flower, eventStrings);
     for (int64_t i = 0; i < stList_length(contigPaths); i++) {
         stList *contigPath = stList_get(contigPaths, i);
         stSortedSet *seen = stSortedSet_construct3((int (*)(const void *, const void *))segmentAndPosition_cmpFn, free);
-        assert(getSplitContigPathIntervalsP(stList_get(contigPath, 0),contigPath, seen, 0) == stList_length(contigPath)-1);
+        int64_t k = getSplitContigPathIntervalsP(stList_get(contigPath, 0), contigPath, seen, 0); //Must not be in the assert, it fills the seen set.
+        assert(k == stList_length(contigPath) - 1);
+        (void)k;
         for (int64_t j = 0; j < stList_length(contigPath); j++) {
             Segment *_5Segment = stList_get(contigPath, j);
             assert(isInSet(seen, _5Segment, j));
@@ -167,7 +186,7 @@ stList *getSplitContigPathIntervals(Flower *flower, stList *contigPaths,
                     segment_getBlock(_5Segment));
             Segment *segment2;
             while ((segment2 = block_getNext(it)) != NULL) {
-                if (segmentIsInEvents(segment2, eventStrings)) {
+                if (eventSet_contains(eventSet, segment_getEvent(segment2))) {
                     if (!isInSet(seen, segment2, j)) {
                         //st_uglyf("Starting interval\n");
                         int64_t k = getSplitContigPathIntervalsP(segment2,
@@ -181,17 +200,19 @@ stList *getSplitContigPathIntervals(Flower *flower, stList *contigPaths,
         }
         stSortedSet_destruct(seen);
     }
+    eventSet_destruct(eventSet);
     return intervals;
 }
 
-static int cmpFn(SequenceInterval *sequenceInteval1,
-        SequenceInterval *sequenceInterval2) {
-    assert(
-            strcmp(sequenceInteval1->sequenceName,
-                    sequenceInterval2->sequenceName) == 0);
-    assert(sequenceInteval1->start != sequenceInterval2->start);
-    return sequenceInteval1->start > sequenceInterval2->start ? 1 : -1;
-}
+/*
+ * The extent of a scaffold path, grown as its contig paths are visited.
+ */
+typedef struct _scaffoldPathExtent {
+    stSortedSet *scaffoldPath;
+    Sequence *sequence;
+    int64_t start;
+    int64_t end;
+} ScaffoldPathExtent;
 
 stList *getScaffoldPathIntervals(Flower *flower, const char *chosenEventString,
         stList *referenceEventStrings, stList *contaminationEventStrings,
@@ -202,35 +223,46 @@ stList *getScaffoldPathIntervals(Flower *flower, const char *chosenEventString,
     stHash *scaffoldPathsHash =
             getScaffoldPaths(contigPaths, referenceEventStrings,
                     contaminationEventStrings, capCodeParameters);
+    /*
+     * Visit the contig paths once, growing the extent of the scaffold path of each. The contig paths of a
+     * scaffold path are on one sequence and do not overlap, so its interval runs from the least start to the
+     * greatest end of its contig paths. Scaffold paths are reported in the order their first contig paths are found.
+     */
+    stHash *scaffoldPathToExtentHash = stHash_construct2(NULL, free);
+    stList *extents = stList_construct();
+    for (int64_t i = 0; i < stList_length(contigPaths); i++) {
+        stList *contigPath = stList_get(contigPaths, i);
+        int64_t start, end;
+        Sequence *sequence = getInterval(stList_get(contigPath, 0),
+                stList_get(contigPath, stList_length(contigPath) - 1), &start, &end);
+        stSortedSet *scaffoldPath = stHash_search(scaffoldPathsHash, contigPath);
+        assert(scaffoldPath != NULL);
+        ScaffoldPathExtent *extent = stHash_search(scaffoldPathToExtentHash, scaffoldPath);
+        if (extent == NULL) {
+            extent = st_malloc(sizeof(ScaffoldPathExtent));
+            extent->scaffoldPath = scaffoldPath;
+            extent->sequence = sequence;
+            extent->start = start;
+            extent->end = end;
+            stHash_insert(scaffoldPathToExtentHash, scaffoldPath, extent);
+            stList_append(extents, extent);
+            continue;
+        }
+        assert(sequence_getMetaSequence(extent->sequence) == sequence_getMetaSequence(sequence));
+        extent->start = start < extent->start ? start : extent->start;
+        extent->end = end > extent->end ? end : extent->end;
+    }
     stList *intervals = stList_construct3(0,
             (void(*)(void *)) sequenceInterval_destruct);
-    stList *scaffoldPathsList = stHash_getValues(scaffoldPathsHash);
-    stSortedSet *scaffoldPathsSet =
-            stList_getSortedSet(scaffoldPathsList, NULL);
-    stList_destruct(scaffoldPathsList);
-    scaffoldPathsList = stSortedSet_getList(scaffoldPathsSet);
-    for (int64_t i = 0; i < stList_length(scaffoldPathsList); i++) {
-        stSortedSet *scaffoldPath = stList_get(scaffoldPathsList, i);
-        stList *scaffoldPathList = stSortedSet_getList(scaffoldPath);
-        stList *scaffoldPathIntervals = getContigPathIntervals(flower,
-                scaffoldPathList, chosenEventString, referenceEventStrings);
-        stList_sort(scaffoldPathIntervals,
-                (int(*)(const void *, const void *)) cmpFn);
-        SequenceInterval *_5SequenceInterval = stList_get(
-                scaffoldPathIntervals, 0);
-        SequenceInterval *_3SequenceInterval =
-                stList_get(scaffoldPathIntervals,
-                        stList_length(scaffoldPathIntervals) - 1);
-        stList_append(
-                intervals,
-                sequenceInterval_construct(_5SequenceInterval->start,
-                        _3SequenceInterval->start + _3SequenceInterval->end,
-                        _5SequenceInterval->sequenceName));
-        stList_destruct(scaffoldPathList);
+    for (int64_t i = 0; i < stList_length(extents); i++) {
+        ScaffoldPathExtent *extent = stList_get(extents, i);
+        stList_append(intervals, sequenceInterval_construct2(extent->start, extent->end,
+                sequence_getHeader(extent->sequence)));
+        stSortedSet_destruct(extent->scaffoldPath);
     }
+    stList_destruct(extents);
+    stHash_destruct(scaffoldPathToExtentHash);
     stList_destruct(contigPaths);
-    stSortedSet_destruct(scaffoldPathsSet);
-    stList_destruct(scaffoldPathsList);
     stHash_destruct(scaffoldPathsHash);
     st_logDebug("Got scaffold path intervals\n");
     return intervals;
@@ -7,44 +7,153 @@
 #include "cactus.h"
 #include "sonLib.h"
 #include "contigPaths.h"
+#include "eventSet.h"
 #include "adjacencyTraversal.h"
 #include "adjacencyClassification.h"
 
-static stHash *getScaffoldPathsP(stList *haplotypePaths, stHash *haplotypePathToScaffoldPathHash,
-        stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters) {
-    stHash *haplotypeToMaximalHaplotypeLengthHash = buildContigPathToContigPathLengthHash(haplotypePaths);
+static Segment *getContigPath5Segment(stList *haplotypePath) {
+    /*
+     * Gets the segment at the 5' end of the contig path, with respect to the positive strand.
+     */
+    assert(stList_length(haplotypePath) > 0);
+    Segment *_5Segment = stList_get(haplotypePath, 0);
+    if (!segment_getStrand(_5Segment)) {
+        _5Segment = segment_getReverse(stList_get(haplotypePath, stList_length(haplotypePath) - 1));
+    }
+    assert(segment_getStrand(_5Segment));
+    return _5Segment;
+}
+
+/*
+ * A disjoint set forest over the contig paths, indexed by their position in the list of paths. Each scaffold
+ * path is a tree, whose root holds the number of contig paths in it and their summed length.
+ */
+typedef struct _scaffoldPathSets {
+    int64_t pathNumber;
+    int64_t *parents;
+    int64_t *sizes; //Only valid for roots.
+    int64_t *lengths; //Only valid for roots.
+} ScaffoldPathSets;
+
+static ScaffoldPathSets *scaffoldPathSets_construct(stList *haplotypePaths) {
+    ScaffoldPathSets *scaffoldPathSets = st_malloc(sizeof(ScaffoldPathSets));
+    scaffoldPathSets->pathNumber = stList_length(haplotypePaths);
+    scaffoldPathSets->parents = st_malloc(sizeof(int64_t) * (scaffoldPathSets->pathNumber + 1));
+    scaffoldPathSets->sizes = st_malloc(sizeof(int64_t) * (scaffoldPathSets->pathNumber + 1));
+    scaffoldPathSets->lengths = st_malloc(sizeof(int64_t) * (scaffoldPathSets->pathNumber + 1));
+    for (int64_t i = 0; i < scaffoldPathSets->pathNumber; i++) {
+        scaffoldPathSets->parents[i] = i;
+        scaffoldPathSets->sizes[i] = 1;
+        scaffoldPathSets->lengths[i] = contigPathLength(stList_get(haplotypePaths, i));
+    }
+    return scaffoldPathSets;
+}
+
+static void scaffoldPathSets_destruct(ScaffoldPathSets *scaffoldPathSets) {
+    free(scaffoldPathSets->parents);
+    free(scaffoldPathSets->sizes);
+    free(scaffoldPathSets->lengths);
+    free(scaffoldPathSets);
+}
+
+static int64_t scaffoldPathSets_find(ScaffoldPathSets *scaffoldPathSets, int64_t i) {
+    int64_t root = i;
+    while (scaffoldPathSets->parents[root] != root) {
+        root = scaffoldPathSets->parents[root];
+    }
+    while (scaffoldPathSets->parents[i] != root) { //Path compression
+        int64_t j = scaffoldPathSets->parents[i];
+        scaffoldPathSets->parents[i] = root;
+        i = j;
+    }
+    return root;
+}
+
+static void scaffoldPathSets_union(ScaffoldPathSets *scaffoldPathSets, int64_t i, int64_t j) {
+    i = scaffoldPathSets_find(scaffoldPathSets, i);
+    j = scaffoldPathSets_find(scaffoldPathSets, j);
+    if (i == j) {
+        return;
+    }
+    if (scaffoldPathSets->sizes[i] < scaffoldPathSets->sizes[j]) { //Union by size
+        int64_t k = i;
+        i = j;
+        j = k;
+    }
+    scaffoldPathSets->parents[j] = i;
+    scaffoldPathSets->sizes[i] += scaffoldPathSets->sizes[j];
+    scaffoldPathSets->lengths[i] += scaffoldPathSets->lengths[j];
+}
+
+static stHash *scaffoldPathSets_getLengthsHash(ScaffoldPathSets *scaffoldPathSets, stList *haplotypePaths) {
+    /*
+     * Gets the hash of contig paths to the lengths of their scaffold paths, as returned by getContigPathToScaffoldPathLengthsHash.
+     */
+    stHash *haplotypeToMaximalHaplotypeLengthHash = stHash_construct();
+    for (int64_t i = 0; i < scaffoldPathSets->pathNumber; i++) {
+        stHash_insert(haplotypeToMaximalHaplotypeLengthHash, stList_get(haplotypePaths, i),
+                stIntTuple_construct1(scaffoldPathSets->lengths[scaffoldPathSets_find(scaffoldPathSets, i)]));
+    }
+    return haplotypeToMaximalHaplotypeLengthHash;
+}
+
+static void scaffoldPathSets_fillScaffoldPathHash(ScaffoldPathSets *scaffoldPathSets, stList *haplotypePaths,
+        stHash *haplotypePathToScaffoldPathHash) {
+    /*
+     * Fills the hash of contig paths to their scaffold paths, as returned by getScaffoldPaths, building one set
+     * of contig paths per scaffold path.
+     */
+    stSortedSet **buckets = st_calloc(scaffoldPathSets->pathNumber + 1, sizeof(stSortedSet *));
+    for (int64_t i = 0; i < scaffoldPathSets->pathNumber; i++) {
+        int64_t j = scaffoldPathSets_find(scaffoldPathSets, i);
+        if (buckets[j] == NULL) {
+            buckets[j] = stSortedSet_construct();
+        }
+        stSortedSet_insert(buckets[j], stList_get(haplotypePaths, i));
+        stHash_insert(haplotypePathToScaffoldPathHash, stList_get(haplotypePaths, i), buckets[j]);
+    }
+    free(buckets);
+}
+
+static ScaffoldPathSets *getScaffoldPathsP(stList *haplotypePaths, EventSet *haplotypeEventSet,
+        EventSet *contaminationEventSet, CapCodeParameters *capCodeParameters) {
+    /*
+     * Joins the contig paths into scaffold paths across the scaffold and ambiguity gaps at their 5' ends.
+     */
+    ScaffoldPathSets *scaffoldPathSets = scaffoldPathSets_construct(haplotypePaths);
     stHash *segmentToMaximalHaplotypePathHash = buildSegmentToContigPathHash(haplotypePaths);
+    stHash *haplotypePathToIndexHash = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
     for (int64_t i = 0; i < stList_length(haplotypePaths); i++) {
-        stSortedSet *bucket = stSortedSet_construct();
-        stHash_insert(haplotypePathToScaffoldPathHash, stList_get(haplotypePaths, i), bucket);
-        stSortedSet_insert(bucket, stList_get(haplotypePaths, i));
+        stHash_insert(haplotypePathToIndexHash, stList_get(haplotypePaths, i), stIntTuple_construct1(i));
     }
-    for (int64_t i = 0; i < stList_length(haplotypePaths); i++) {
-        stList *haplotypePath = stList_get(haplotypePaths, i);
-        assert(stList_length(haplotypePath) > 0);
-        Segment *_5Segment = stList_get(haplotypePath, 0);
-        if (!segment_getStrand(_5Segment)) {
-            _5Segment = segment_getReverse(stList_get(haplotypePath, stList_length(haplotypePath) - 1));
+    //Classify the 5' ends of all the paths in one batch.
+    int64_t pathNumber = stList_length(haplotypePaths);
+    Cap **_5Caps = st_malloc(sizeof(Cap *) * (pathNumber + 1));
+    enum CapCode *_5CapCodes = st_malloc(sizeof(enum CapCode) * (pathNumber + 1));
+    Cap **otherCaps = st_malloc(sizeof(Cap *) * (pathNumber + 1));
+    int64_t *insertLengths = st_malloc(sizeof(int64_t) * (pathNumber + 1));
+    int64_t *deleteLengths = st_malloc(sizeof(int64_t) * (pathNumber + 1));
+    for (int64_t i = 0; i < pathNumber; i++) {
+        _5Caps[i] = segment_get5Cap(getContigPath5Segment(stList_get(haplotypePaths, i)));
+        if (getAdjacentCapsSegment(_5Caps[i]) != NULL) {
+            assert(!trueAdjacencyInEventSet(_5Caps[i], haplotypeEventSet));
         }
-        assert(segment_getStrand(_5Segment));
-        if (getAdjacentCapsSegment(segment_get5Cap(_5Segment)) != NULL) {
-            assert(!trueAdjacency(segment_get5Cap(_5Segment), haplotypeEventStrings));
-        }
-        int64_t insertLength;
-        int64_t deleteLength;
-        Cap *otherCap;
-        enum CapCode _5CapCode = getCapCode(segment_get5Cap(_5Segment), &otherCap, haplotypeEventStrings, contaminationEventStrings, &insertLength, &deleteLength, capCodeParameters);
+    }
+    getCapCodesInEventSets(_5Caps, pathNumber, _5CapCodes, otherCaps, insertLengths, deleteLengths,
+            haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    for (int64_t i = 0; i < pathNumber; i++) {
+        stList *haplotypePath = stList_get(haplotypePaths, i);
+        Segment *_5Segment = getContigPath5Segment(haplotypePath);
+        enum CapCode _5CapCode = _5CapCodes[i];
         if (_5CapCode == SCAFFOLD_GAP || _5CapCode == AMBIGUITY_GAP) {
-            assert(stHash_search(haplotypeToMaximalHaplotypeLengthHash, haplotypePath) != NULL);
-            int64_t j = stIntTuple_get(stHash_search(haplotypeToMaximalHaplotypeLengthHash, haplotypePath), 0);
             Segment *adjacentSegment = getAdjacentCapsSegment(segment_get5Cap(_5Segment));
             assert(adjacentSegment != NULL);
-            while (!hasCapInEvents(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventStrings)) { //is not a haplotype end
+            while (!hasCapInEventSet(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventSet)) { //is not a haplotype end
                 adjacentSegment = getAdjacentCapsSegment(segment_get5Cap(adjacentSegment));
                 assert(adjacentSegment != NULL);
             }
             assert(adjacentSegment != NULL);
-            assert(hasCapInEvents(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventStrings)); //is a haplotype end
+            assert(hasCapInEventSet(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventSet)); //is a haplotype end
             stList *adjacentHaplotypePath = stHash_search(segmentToMaximalHaplotypePathHash, adjacentSegment);
             if (adjacentHaplotypePath == NULL) {
                 adjacentHaplotypePath = stHash_search(segmentToMaximalHaplotypePathHash, segment_getReverse(
@@ -52,121 +161,177 @@ static stHash *getScaffoldPathsP(stList *haplotypePaths, stHash *haplotypePathTo
             }
             assert(adjacentHaplotypePath != NULL);
             assert(adjacentHaplotypePath != haplotypePath);
-            assert(stHash_search(haplotypeToMaximalHaplotypeLengthHash, adjacentHaplotypePath) != NULL);
-            int64_t k = stIntTuple_get(stHash_search(haplotypeToMaximalHaplotypeLengthHash, adjacentHaplotypePath), 0);
-
-            //Now merge the buckets and make new int tuples..
-            stSortedSet *bucket1 = stHash_search(haplotypePathToScaffoldPathHash, haplotypePath);
-            stSortedSet *bucket2 = stHash_search(haplotypePathToScaffoldPathHash, adjacentHaplotypePath);
-            assert(bucket1 != NULL);
-            assert(bucket2 != NULL);
-            assert(bucket1 != bucket2);
-            stSortedSet *bucket3 = stSortedSet_getUnion(bucket1, bucket2);
-            stSortedSetIterator *bucketIt = stSortedSet_getIterator(bucket3);
-            stList *l;
-            while ((l = stSortedSet_getNext(bucketIt)) != NULL) {
-                //Do the bucket first
-                assert(stHash_search(haplotypePathToScaffoldPathHash, l) == bucket1 || stHash_search(haplotypePathToScaffoldPathHash, l) == bucket2);
-                stHash_remove(haplotypePathToScaffoldPathHash, l);
-                stHash_insert(haplotypePathToScaffoldPathHash, l, bucket3);
-                //Now the length
-                stIntTuple *m = stHash_remove(haplotypeToMaximalHaplotypeLengthHash, l);
-                assert(m != NULL);
-                assert(stIntTuple_get(m, 0) == j || stIntTuple_get(m, 0) == k);
-                stHash_insert(haplotypeToMaximalHaplotypeLengthHash, l, stIntTuple_construct1( j + k));
-                stIntTuple_destruct(m);
-            }
-            assert(stHash_search(haplotypePathToScaffoldPathHash, haplotypePath) == bucket3);
-            assert(stHash_search(haplotypePathToScaffoldPathHash, adjacentHaplotypePath) == bucket3);
-            stSortedSet_destructIterator(bucketIt);
+            stIntTuple *j = stHash_search(haplotypePathToIndexHash, adjacentHaplotypePath);
+            assert(j != NULL);
+            assert(scaffoldPathSets_find(scaffoldPathSets, i) != scaffoldPathSets_find(scaffoldPathSets, stIntTuple_get(j, 0)));
+            scaffoldPathSets_union(scaffoldPathSets, i, stIntTuple_get(j, 0));
         }
     }
+    free(_5Caps);
+    free(_5CapCodes);
+    free(otherCaps);
+    free(insertLengths);
+    free(deleteLengths);
+    stHash_destruct(haplotypePathToIndexHash);
     stHash_destruct(segmentToMaximalHaplotypePathHash);
-    return haplotypeToMaximalHaplotypeLengthHash;
+    return scaffoldPathSets;
 }
 
-static void debugScaffoldPathsP(Cap *cap, stList *haplotypePath,
+static void checkScaffoldPathsCondition(bool condition, const char *description) {
+    if (!condition) {
+        st_errAbort("Invalid scaffold paths: %s", description);
+    }
+}
+
+static void checkScaffoldPathsP2(Cap *cap, enum CapCode capCode, stList *haplotypePath,
         stHash *haplotypePathToScaffoldPathHash, stHash *haplotypeToMaximalHaplotypeLengthHash,
-        stHash *segmentToMaximalHaplotypePathHash, stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters, bool capDir) {
-    int64_t insertLength;
-    int64_t deleteLength;
-    Cap *otherCap;
-    enum CapCode capCode = getCapCode(cap, &otherCap, haplotypeEventStrings, contaminationEventStrings, &insertLength, &deleteLength, capCodeParameters);
+        stHash *segmentToMaximalHaplotypePathHash, EventSet *haplotypeEventSet, bool capDir) {
     if (capCode == SCAFFOLD_GAP || capCode == AMBIGUITY_GAP) {
         Segment *adjacentSegment = getAdjacentCapsSegment(cap);
-        assert(adjacentSegment != NULL);
-        while (!hasCapInEvents(cap_getEnd(capDir ? segment_get5Cap(adjacentSegment) : segment_get3Cap(adjacentSegment)), haplotypeEventStrings)) {
+        checkScaffoldPathsCondition(adjacentSegment != NULL, "a gap has no adjacent segment");
+        while (!hasCapInEventSet(cap_getEnd(capDir ? segment_get5Cap(adjacentSegment) : segment_get3Cap(adjacentSegment)), haplotypeEventSet)) {
             adjacentSegment = getAdjacentCapsSegment(capDir ? segment_get5Cap(adjacentSegment) : segment_get3Cap(adjacentSegment));
-            assert(adjacentSegment != NULL);
+            checkScaffoldPathsCondition(adjacentSegment != NULL, "a gap is not bridged to a haplotype segment");
         }
-        assert(adjacentSegment != NULL);
-        assert(hasCapInEvents(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventStrings)); //isHaplotypeEnd(cap_getEnd(segment_get5Cap(adjacentSegment))));
-        stIntTuple *j = stHash_search(haplotypeToMaximalHaplotypeLengthHash, haplotypePath);
-        (void)j;
-        assert(j != NULL);
+        checkScaffoldPathsCondition(hasCapInEventSet(cap_getEnd(segment_get5Cap(adjacentSegment)), haplotypeEventSet),
+                "a gap is not bridged to a haplotype segment");
         stList *adjacentHaplotypePath = stHash_search(segmentToMaximalHaplotypePathHash, adjacentSegment);
         if (adjacentHaplotypePath == NULL) {
             adjacentHaplotypePath = stHash_search(segmentToMaximalHaplotypePathHash,
                     segment_getReverse(adjacentSegment));
         }
-        assert(adjacentHaplotypePath != NULL);
-        assert(adjacentHaplotypePath != haplotypePath);
-        stIntTuple *k = stHash_search(haplotypeToMaximalHaplotypeLengthHash, adjacentHaplotypePath);
-        (void)k;
-        assert(k != NULL);
-        assert(stIntTuple_get(j, 0) == stIntTuple_get(k, 0));
-        assert(stHash_search(haplotypePathToScaffoldPathHash, haplotypePath) ==
-                stHash_search(haplotypePathToScaffoldPathHash, adjacentHaplotypePath));
+        checkScaffoldPathsCondition(adjacentHaplotypePath != NULL && adjacentHaplotypePath != haplotypePath,
+                "a gap is not bridged to another contig path");
+        if (haplotypeToMaximalHaplotypeLengthHash != NULL) {
+            stIntTuple *j = stHash_search(haplotypeToMaximalHaplotypeLengthHash, haplotypePath);
+            stIntTuple *k = stHash_search(haplotypeToMaximalHaplotypeLengthHash, adjacentHaplotypePath);
+            checkScaffoldPathsCondition(j != NULL && k != NULL, "a contig path has no scaffold path length");
+            checkScaffoldPathsCondition(stIntTuple_get(j, 0) == stIntTuple_get(k, 0),
+                    "contig paths bridged by a gap have different scaffold path lengths");
+        }
+        if (haplotypePathToScaffoldPathHash != NULL) {
+            checkScaffoldPathsCondition(stHash_search(haplotypePathToScaffoldPathHash, haplotypePath) ==
+                    stHash_search(haplotypePathToScaffoldPathHash, adjacentHaplotypePath),
+                    "contig paths bridged by a gap are in different scaffold paths");
+        }
     }
 }
 
-static void debugScaffoldPaths(stList *haplotypePaths, stHash *haplotypePathToScaffoldPathHash,
-        stHash *haplotypeToMaximalHaplotypeLengthHash, stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters) {
+static void checkScaffoldPathsP(stList *haplotypePaths, stHash *haplotypePathToScaffoldPathHash,
+        stHash *haplotypeToMaximalHaplotypeLengthHash, EventSet *haplotypeEventSet, EventSet *contaminationEventSet, CapCodeParameters *capCodeParameters) {
     stHash *segmentToMaximalHaplotypePathHash = buildSegmentToContigPathHash(haplotypePaths);
+    //Classify both ends of all the paths in one batch, the 5' cap of path i at 2i and the 3' cap at 2i+1.
+    int64_t capNumber = 2 * stList_length(haplotypePaths);
+    Cap **caps = st_malloc(sizeof(Cap *) * (capNumber + 1));
+    enum CapCode *capCodes = st_malloc(sizeof(enum CapCode) * (capNumber + 1));
+    Cap **otherCaps = st_malloc(sizeof(Cap *) * (capNumber + 1));
+    int64_t *insertLengths = st_malloc(sizeof(int64_t) * (capNumber + 1));
+    int64_t *deleteLengths = st_malloc(sizeof(int64_t) * (capNumber + 1));
     for (int64_t i = 0; i < stList_length(haplotypePaths); i++) {
         stList *haplotypePath = stList_get(haplotypePaths, i);
-        assert(stList_length(haplotypePath) > 0);
+        checkScaffoldPathsCondition(stList_length(haplotypePath) > 0, "a contig path is empty");
         //Traversing from 5' end..
         Segment *_5Segment = stList_get(haplotypePath, 0);
         Segment *_3Segment = stList_get(haplotypePath, stList_length(haplotypePath) - 1);
-        assert(segment_getStrand(_5Segment) == segment_getStrand(_3Segment));
+        checkScaffoldPathsCondition(segment_getStrand(_5Segment) == segment_getStrand(_3Segment),
+                "the ends of a contig path are on different strands");
         if (!segment_getStrand(_5Segment)) {
             Segment *j = _5Segment;
             _5Segment = segment_getReverse(_3Segment);
             _3Segment = segment_getReverse(j);
         }
-        assert(segment_getStrand(_5Segment));
-        assert(segment_getStrand(_3Segment));
         Cap *_5Cap = segment_get5Cap(_5Segment);
         Cap *_3Cap = segment_get3Cap(_3Segment);
         if (getAdjacentCapsSegment(_5Cap) != NULL) {
-            assert(!trueAdjacency(_5Cap, haplotypeEventStrings));
+            checkScaffoldPathsCondition(!trueAdjacencyInEventSet(_5Cap, haplotypeEventSet), "a contig path is not maximal");
         }
         if (getAdjacentCapsSegment(_3Cap) != NULL) {
-            assert(!trueAdjacency(_3Cap, haplotypeEventStrings));
+            checkScaffoldPathsCondition(!trueAdjacencyInEventSet(_3Cap, haplotypeEventSet), "a contig path is not maximal");
         }
-        debugScaffoldPathsP(_5Cap, haplotypePath,
+        caps[2 * i] = _5Cap;
+        caps[2 * i + 1] = _3Cap;
+    }
+    getCapCodesInEventSets(caps, capNumber, capCodes, otherCaps, insertLengths, deleteLengths,
+            haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    for (int64_t i = 0; i < stList_length(haplotypePaths); i++) {
+        stList *haplotypePath = stList_get(haplotypePaths, i);
+        checkScaffoldPathsP2(caps[2 * i], capCodes[2 * i], haplotypePath,
                 haplotypePathToScaffoldPathHash, haplotypeToMaximalHaplotypeLengthHash,
-                segmentToMaximalHaplotypePathHash, haplotypeEventStrings, contaminationEventStrings, capCodeParameters, 1);
-        debugScaffoldPathsP(_3Cap, haplotypePath,
+                segmentToMaximalHaplotypePathHash, haplotypeEventSet, 1);
+        checkScaffoldPathsP2(caps[2 * i + 1], capCodes[2 * i + 1], haplotypePath,
                 haplotypePathToScaffoldPathHash, haplotypeToMaximalHaplotypeLengthHash,
-                segmentToMaximalHaplotypePathHash, haplotypeEventStrings, contaminationEventStrings, capCodeParameters, 0);
+                segmentToMaximalHaplotypePathHash, haplotypeEventSet, 0);
     }
+    free(caps);
+    free(capCodes);
+    free(otherCaps);
+    free(insertLengths);
+    free(deleteLengths);
     stHash_destruct(segmentToMaximalHaplotypePathHash);
 }
 
+static Flower *getFlowerForContigPaths(stList *haplotypePaths) {
+    /*
+     * Gets a flower containing the contig paths, from which to build event sets, or NULL if there are no paths.
+     */
+    if (stList_length(haplotypePaths) == 0) {
+        return NULL;
+    }
+    stList *haplotypePath = stList_get(haplotypePaths, 0);
+    assert(stList_length(haplotypePath) > 0);
+    return block_getFlower(segment_getBlock(stList_get(haplotypePath, 0)));
+}
+
+void checkScaffoldPaths(stList *haplotypePaths, stHash *haplotypePathToScaffoldPathHash, stHash *haplotypeToMaximalHaplotypeLengthHash,
+        stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters) {
+    Flower *flower = getFlowerForContigPaths(haplotypePaths);
+    if (flower == NULL) {
+        return;
+    }
+    EventSet *haplotypeEventSet = eventSet_construct(flower, haplotypeEventStrings);
+    EventSet *contaminationEventSet = eventSet_construct(flower, contaminationEventStrings);
+    checkScaffoldPathsP(haplotypePaths, haplotypePathToScaffoldPathHash, haplotypeToMaximalHaplotypeLengthHash,
+            haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    eventSet_destruct(haplotypeEventSet);
+    eventSet_destruct(contaminationEventSet);
+}
+
 stHash *getContigPathToScaffoldPathLengthsHash(stList *haplotypePaths, stList *haplotyoeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters) {
     stHash *haplotypePathToScaffoldPathHash = stHash_construct();
-    stHash *i = getScaffoldPathsP(haplotypePaths, haplotypePathToScaffoldPathHash, haplotyoeEventStrings, contaminationEventStrings, capCodeParameters);
-    debugScaffoldPaths(haplotypePaths, haplotypePathToScaffoldPathHash, i, haplotyoeEventStrings, contaminationEventStrings, capCodeParameters);
+    Flower *flower = getFlowerForContigPaths(haplotypePaths);
+    EventSet *haplotypeEventSet = flower != NULL ? eventSet_construct(flower, haplotyoeEventStrings) : NULL;
+    EventSet *contaminationEventSet = flower != NULL ? eventSet_construct(flower, contaminationEventStrings) : NULL;
+    ScaffoldPathSets *scaffoldPathSets = getScaffoldPathsP(haplotypePaths, haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    stHash *i = scaffoldPathSets_getLengthsHash(scaffoldPathSets, haplotypePaths);
+#ifndef NDEBUG
+    scaffoldPathSets_fillScaffoldPathHash(scaffoldPathSets, haplotypePaths, haplotypePathToScaffoldPathHash);
+    checkScaffoldPathsP(haplotypePaths, haplotypePathToScaffoldPathHash, i, haplotypeEventSet, contaminationEventSet, capCodeParameters);
+#endif
+    scaffoldPathSets_destruct(scaffoldPathSets);
     stHash_destruct(haplotypePathToScaffoldPathHash);
+    if (flower != NULL) {
+        eventSet_destruct(haplotypeEventSet);
+        eventSet_destruct(contaminationEventSet);
+    }
     return i;
 }
 
 stHash *getScaffoldPaths(stList *haplotypePaths, stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters) {
     stHash *haplotypePathToScaffoldPathHash = stHash_construct();
-    stHash *i = getScaffoldPathsP(haplotypePaths, haplotypePathToScaffoldPathHash, haplotypeEventStrings, contaminationEventStrings, capCodeParameters);
-    debugScaffoldPaths(haplotypePaths, haplotypePathToScaffoldPathHash, i, haplotypeEventStrings, contaminationEventStrings, capCodeParameters);
+    Flower *flower = getFlowerForContigPaths(haplotypePaths);
+    EventSet *haplotypeEventSet = flower != NULL ? eventSet_construct(flower, haplotypeEventStrings) : NULL;
+    EventSet *contaminationEventSet = flower != NULL ? eventSet_construct(flower, contaminationEventStrings) : NULL;
+    ScaffoldPathSets *scaffoldPathSets = getScaffoldPathsP(haplotypePaths, haplotypeEventSet, contaminationEventSet, capCodeParameters);
+    scaffoldPathSets_fillScaffoldPathHash(scaffoldPathSets, haplotypePaths, haplotypePathToScaffoldPathHash);
+#ifndef NDEBUG
+    stHash *i = scaffoldPathSets_getLengthsHash(scaffoldPathSets, haplotypePaths);
+    checkScaffoldPathsP(haplotypePaths, haplotypePathToScaffoldPathHash, i, haplotypeEventSet, contaminationEventSet, capCodeParameters);
     stHash_destruct(i);
+#endif
+    scaffoldPathSets_destruct(scaffoldPathSets);
+    if (flower != NULL) {
+        eventSet_destruct(haplotypeEventSet);
+        eventSet_destruct(contaminationEventSet);
+    }
     return haplotypePathToScaffoldPathHash;
 }
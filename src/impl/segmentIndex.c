@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "parallel.h"
+#include "flowerHierarchy.h"
+#include "segmentIndex.h"
+
+/*
+ * The number of segments whose duplication flags are computed by one job.
+ */
+#define SEGMENT_INDEX_DUPLICATION_JOB_SIZE 4096
+
+typedef struct _segmentIndexSequence {
+    Name name; //The name of the meta sequence, also the key of the entry.
+    int64_t *starts; //Pointers into the arrays of the index.
+    int64_t *lengths;
+    Segment **segments;
+    bool *duplicated;
+    int64_t segmentNumber;
+} SegmentIndexSequence;
+
+struct _segmentIndex {
+    int64_t *starts; //The segments, grouped by meta sequence and ordered by start within each group.
+    int64_t *lengths;
+    Segment **segments;
+    bool *duplicated; //Whether another segment of the block is on the same meta sequence.
+    int64_t segmentNumber;
+    stHash *sequences; //Meta sequence names to their group of segments.
+};
+
+typedef struct _segmentIndexEntry {
+    Name name;
+    int64_t start;
+    Segment *segment;
+} SegmentIndexEntry;
+
+static uint64_t nameHashKey(const void *name) {
+    return *(const Name *) name;
+}
+
+static int nameEqualsKey(const void *name1, const void *name2) {
+    return *(const Name *) name1 == *(const Name *) name2;
+}
+
+static int segmentIndexEntryCmpFn(const void *a, const void *b) {
+    const SegmentIndexEntry *entry1 = a, *entry2 = b;
+    int i = cactusMisc_nameCompare(entry1->name, entry2->name);
+    if (i != 0) {
+        return i;
+    }
+    return entry1->start > entry2->start ? 1 : (entry1->start < entry2->start ? -1 : 0);
+}
+
+static bool duplicated(Segment *segment) {
+    Sequence *sequence = segment_getSequence(segment);
+    assert(sequence != NULL);
+    MetaSequence *metaSequence = sequence_getMetaSequence(sequence);
+    Block *block = segment_getBlock(segment);
+    Block_InstanceIterator *it = block_getInstanceIterator(block);
+    Segment *segment2;
+    while((segment2 = block_getNext(it)) != NULL) {
+       if(segment != segment2) {
+           assert(segment != segment_getReverse(segment2));
+           Sequence *sequence2 = segment_getSequence(segment2);
+           if(sequence2 != NULL && sequence_getMetaSequence(sequence2) == metaSequence) {
+               block_destructInstanceIterator(it);
+               return 1;
+           }
+       }
+    }
+    block_destructInstanceIterator(it);
+    return 0;
+}
+
+static void computeDuplicatedJob(int64_t jobIndex, int64_t threadIndex, void *extraArg) {
+    SegmentIndex *segmentIndex = extraArg;
+    int64_t end = (jobIndex + 1) * SEGMENT_INDEX_DUPLICATION_JOB_SIZE;
+    end = end < segmentIndex->segmentNumber ? end : segmentIndex->segmentNumber;
+    for (int64_t i = jobIndex * SEGMENT_INDEX_DUPLICATION_JOB_SIZE; i < end; i++) {
+        segmentIndex->duplicated[i] = duplicated(segmentIndex->segments[i]);
+    }
+}
+
+static SegmentIndex *segmentIndex_constructP(stList *segments, int64_t threadNumber) {
+    /*
+     * Builds the index from a list of positively oriented segments, in any order.
+     */
+    int64_t segmentNumber = stList_length(segments);
+    SegmentIndexEntry *entries = st_malloc(sizeof(SegmentIndexEntry) * (segmentNumber + 1));
+    int64_t j = 0;
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        Segment *segment = stList_get(segments, i);
+        assert(segment_getStrand(segment));
+        Sequence *sequence = segment_getSequence(segment);
+        if (sequence != NULL) {
+            entries[j].name = metaSequence_getName(sequence_getMetaSequence(sequence));
+            entries[j].start = segment_getStart(segment);
+            entries[j++].segment = segment;
+        }
+    }
+    segmentNumber = j;
+    sortInParallel(entries, segmentNumber, sizeof(SegmentIndexEntry), segmentIndexEntryCmpFn, threadNumber);
+
+    SegmentIndex *segmentIndex = st_malloc(sizeof(SegmentIndex));
+    segmentIndex->segmentNumber = segmentNumber;
+    segmentIndex->starts = st_malloc(sizeof(int64_t) * (segmentNumber + 1));
+    segmentIndex->lengths = st_malloc(sizeof(int64_t) * (segmentNumber + 1));
+    segmentIndex->segments = st_malloc(sizeof(Segment *) * (segmentNumber + 1));
+    segmentIndex->duplicated = st_malloc(sizeof(bool) * (segmentNumber + 1));
+    segmentIndex->sequences = stHash_construct3(nameHashKey, nameEqualsKey, NULL, free);
+    SegmentIndexSequence *indexSequence = NULL;
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        segmentIndex->starts[i] = entries[i].start;
+        segmentIndex->lengths[i] = segment_getLength(entries[i].segment);
+        segmentIndex->segments[i] = entries[i].segment;
+        if (indexSequence == NULL || indexSequence->name != entries[i].name) {
+            indexSequence = st_malloc(sizeof(SegmentIndexSequence));
+            indexSequence->name = entries[i].name;
+            indexSequence->starts = segmentIndex->starts + i;
+            indexSequence->lengths = segmentIndex->lengths + i;
+            indexSequence->segments = segmentIndex->segments + i;
+            indexSequence->duplicated = segmentIndex->duplicated + i;
+            indexSequence->segmentNumber = 0;
+            stHash_insert(segmentIndex->sequences, &indexSequence->name, indexSequence);
+        }
+        assert(indexSequence->segmentNumber == 0
+                || indexSequence->starts[indexSequence->segmentNumber - 1] + indexSequence->lengths[indexSequence->segmentNumber - 1] <= entries[i].start);
+        indexSequence->segmentNumber++;
+    }
+    free(entries);
+    runInParallel((segmentNumber + SEGMENT_INDEX_DUPLICATION_JOB_SIZE - 1) / SEGMENT_INDEX_DUPLICATION_JOB_SIZE,
+            threadNumber, computeDuplicatedJob, segmentIndex);
+    return segmentIndex;
+}
+
+SegmentIndex *segmentIndex_construct(Flower *flower, int64_t threadNumber) {
+    if (threadNumber < 1) {
+        threadNumber = 1;
+    }
+    stList *segments = getNestedSegmentsInParallel(flower, threadNumber);
+    SegmentIndex *segmentIndex = segmentIndex_constructP(segments, threadNumber);
+    stList_destruct(segments);
+    return segmentIndex;
+}
+
+SegmentIndex *segmentIndex_construct2(stSortedSet *sortedSegments, int64_t threadNumber) {
+    stList *segments = stSortedSet_getList(sortedSegments);
+    SegmentIndex *segmentIndex = segmentIndex_constructP(segments, threadNumber);
+    stList_destruct(segments);
+    return segmentIndex;
+}
+
+void segmentIndex_destruct(SegmentIndex *segmentIndex) {
+    stHash_destruct(segmentIndex->sequences);
+    free(segmentIndex->starts);
+    free(segmentIndex->lengths);
+    free(segmentIndex->segments);
+    free(segmentIndex->duplicated);
+    free(segmentIndex);
+}
+
+static SegmentIndexSequence *segmentIndex_getSequence(SegmentIndex *segmentIndex, MetaSequence *metaSequence) {
+    Name name = metaSequence_getName(metaSequence);
+    return stHash_search(segmentIndex->sequences, &name);
+}
+
+int64_t segmentIndex_getSegmentNumber(SegmentIndex *segmentIndex, MetaSequence *metaSequence) {
+    SegmentIndexSequence *indexSequence = segmentIndex_getSequence(segmentIndex, metaSequence);
+    return indexSequence != NULL ? indexSequence->segmentNumber : 0;
+}
+
+void segmentIndex_initialiseCursor(SegmentIndex *segmentIndex, MetaSequence *metaSequence, SegmentIndexCursor *cursor) {
+    SegmentIndexSequence *indexSequence = segmentIndex_getSequence(segmentIndex, metaSequence);
+    if (indexSequence == NULL) {
+        cursor->starts = NULL;
+        cursor->lengths = NULL;
+        cursor->segments = NULL;
+        cursor->duplicated = NULL;
+        cursor->segmentNumber = 0;
+        return;
+    }
+    cursor->starts = indexSequence->starts;
+    cursor->lengths = indexSequence->lengths;
+    cursor->segments = indexSequence->segments;
+    cursor->duplicated = indexSequence->duplicated;
+    cursor->segmentNumber = indexSequence->segmentNumber;
+}
+
+Segment *segmentIndexCursor_getSegment(SegmentIndexCursor *cursor, int64_t x) {
+    if (cursor->segmentNumber == 0) {
+        return NULL;
+    }
+    /*
+     * Finds the last segment starting at or before x. The loop has a fixed number of iterations
+     * for a given number of segments and the conditional move is branch free.
+     */
+    const int64_t *base = cursor->starts;
+    int64_t n = cursor->segmentNumber;
+    while (n > 1) {
+        int64_t half = n / 2;
+        base = base[half] <= x ? base + half : base;
+        n -= half;
+    }
+    int64_t i = base - cursor->starts;
+    if (*base <= x && x < *base + cursor->lengths[i]) {
+        return cursor->segments[i];
+    }
+    return NULL;
+}
+
+Segment *segmentIndexCursor_getNextSegment(SegmentIndexCursor *cursor, int64_t x, int64_t *position) {
+    int64_t i = *position;
+    if (i >= cursor->segmentNumber || cursor->starts[i] > x) {
+        return NULL;
+    }
+    //Gallop forward, keeping the invariant that the ith segment starts at or before x.
+    int64_t step = 1;
+    while (i + step < cursor->segmentNumber && cursor->starts[i + step] <= x) {
+        i += step;
+        step *= 2;
+    }
+    int64_t j = i + step < cursor->segmentNumber ? i + step : cursor->segmentNumber;
+    while (j - i > 1) {
+        int64_t k = i + (j - i) / 2;
+        if (cursor->starts[k] <= x) {
+            i = k;
+        } else {
+            j = k;
+        }
+    }
+    *position = i;
+    if (x < cursor->starts[i] + cursor->lengths[i]) {
+        return cursor->segments[i];
+    }
+    return NULL;
+}
+
+Segment *segmentIndex_getSegment(SegmentIndex *segmentIndex, MetaSequence *metaSequence, int64_t x) {
+    SegmentIndexCursor cursor;
+    segmentIndex_initialiseCursor(segmentIndex, metaSequence, &cursor);
+    return segmentIndexCursor_getSegment(&cursor, x);
+}
@@ -9,11 +9,18 @@
 
 #include "cactus.h"
 #include "sonLib.h"
+#include "eventSet.h"
+#include "nRunIndex.h"
 
 /*
  * Functions to get the 'code' of an adjacency.
  */
 
+/*
+ * A table of precomputed cap codes, see capCodeTable_construct.
+ */
+typedef struct _capCodeTable CapCodeTable;
+
 /*
  * A wrapper structure to represent parameters to the getCapCode function.
  */
@@ -21,6 +28,8 @@ typedef struct _CapCodeParameters {
         int64_t minimumNCount;
         int64_t maxInsertionLength;
         int64_t maxDeletionLength;
+        NRunIndex *nRunIndex;
+        CapCodeTable *capCodeTable;
 } CapCodeParameters;
 
 /*
@@ -31,6 +40,11 @@ typedef struct _CapCodeParameters {
  * Similarly maxDeletionLength is the maximum size of a deletion with respect to the chosen thread before
  * it is reclassified as simply an intra chromosomal rearrangement.
  *
+ * The nRunIndex is initially NULL. If it is set (it is not owned by the parameters) Ns in the
+ * indexed sequences are counted with the index, rather than by fetching and scanning sequence.
+ *
+ * The capCodeTable is initially NULL. If it is set (it is not owned by the parameters) the codes of the caps
+ * in the table are read from it, rather than computed.
  */
 CapCodeParameters *capCodeParameters_construct(int64_t minimumNCount,
                                                int64_t maxInsertionLength,
@@ -84,6 +98,59 @@ enum CapCode {
 enum CapCode getCapCode(Cap *cap, Cap **otherCap, stList *haplotypeEventStrings, stList *contaminationEventStrings, int64_t *insertLength, int64_t *deleteLength,
                         CapCodeParameters *capCodeParameters);
 
+/*
+ * As getCapCode, but with the haplotype and contamination events given as event sets.
+ */
+enum CapCode getCapCodeInEventSets(Cap *cap, Cap **otherCap, EventSet *haplotypeEventSet, EventSet *contaminationEventSet, int64_t *insertLength, int64_t *deleteLength,
+                        CapCodeParameters *capCodeParameters);
+
+/*
+ * Gets the codes of capNumber caps at once. capCodes, otherCaps, insertLengths and deleteLengths are caller
+ * provided arrays of at least capNumber length, which are initialised with the values getCapCode would return
+ * for each cap (otherCaps[i] is NULL and the lengths are zero where getCapCode would not set them).
+ * The event sets, and so the cached event masks of the ends, are shared by the whole batch.
+ */
+void getCapCodes(Cap **caps, int64_t capNumber, enum CapCode *capCodes, Cap **otherCaps,
+                 int64_t *insertLengths, int64_t *deleteLengths, stList *haplotypeEventStrings, stList *contaminationEventStrings,
+                 CapCodeParameters *capCodeParameters);
+
+/*
+ * As getCapCodes, but with the haplotype and contamination events given as event sets.
+ */
+void getCapCodesInEventSets(Cap **caps, int64_t capNumber, enum CapCode *capCodes, Cap **otherCaps,
+                            int64_t *insertLengths, int64_t *deleteLengths, EventSet *haplotypeEventSet, EventSet *contaminationEventSet,
+                            CapCodeParameters *capCodeParameters);
 
+/*
+ * Computes the cap code, other cap, insert length and delete length of every cap of a segment of the chosen event
+ * in the flower and its nested flowers whose end has a haplotype cap, that is, of every cap whose contig path may
+ * end there. If chosenEventString is NULL the caps of segments of all events are included. The codes are
+ * computed with threadNumber threads (see runInParallel), or serially unless the N run index of capCodeParameters
+ * covers the meta sequences of all the classified caps, as otherwise Ns are counted by fetching sequence, which is
+ * not thread safe.
+ *
+ * Once built the table is read only, and is used by setting the capCodeTable of the parameters. Caps are looked up
+ * by name. The table must only be used with the haplotype and contamination events and the parameters
+ * it was built with.
+ */
+CapCodeTable *capCodeTable_construct(Flower *flower, const char *chosenEventString, stList *haplotypeEventStrings,
+                                     stList *contaminationEventStrings, CapCodeParameters *capCodeParameters, int64_t threadNumber);
+
+/*
+ * Frees the memory associated with the table.
+ */
+void capCodeTable_destruct(CapCodeTable *capCodeTable);
+
+/*
+ * Returns the number of caps in the table.
+ */
+int64_t capCodeTable_size(CapCodeTable *capCodeTable);
+
+/*
+ * If the cap is in the table returns non-zero and sets the code and, as getCapCode would, the other cap and
+ * lengths. Otherwise returns zero.
+ */
+bool capCodeTable_getCapCode(CapCodeTable *capCodeTable, Cap *cap, enum CapCode *capCode, Cap **otherCap,
+                             int64_t *insertLength, int64_t *deleteLength);
 
 #endif /* ASSEMBLYERRORSTRUCTURES_H_ */
@@ -9,6 +9,7 @@
 
 #include "cactus.h"
 #include "sonLib.h"
+#include "eventSet.h"
 
 /*
  * Basic library of functions used in tracing paths through the graph.
@@ -44,16 +45,51 @@ bool hasCapNotInEvent(End *end, const char *eventString);
  */
 bool hasCapInEvents(End *end, stList *eventStrings);
 
+/*
+ * As hasCapInEvents, but with the events given as an event set. The answer is read from (and cached in)
+ * the event set's per-end bitmask cache, see eventSet_getCachedEndMask().
+ */
+bool hasCapInEventSet(End *end, EventSet *eventSet);
+
 /*
  * Returns the terminal adjacency for the given cap.
  */
 Cap *getTerminalCap(Cap *cap);
 
+/*
+ * An index from cap names to the terminal cap and the segment of every cap in a flower hierarchy,
+ * which makes getTerminalCap and getCapsSegment constant time instead of linear in the depth of the tree.
+ */
+typedef struct _terminalCapIndex TerminalCapIndex;
+
+/*
+ * Builds the index for all the caps in the flower and its nested flowers.
+ */
+TerminalCapIndex *terminalCapIndex_construct(Flower *flower);
+
+/*
+ * Frees the memory associated with the index.
+ */
+void terminalCapIndex_destruct(TerminalCapIndex *terminalCapIndex);
+
+/*
+ * If non-NULL the traversal functions (getTerminalCap, getCapsSegment and their callers)
+ * resolve caps using this index, falling back to walking the hierarchy for caps not in it.
+ * The index must be rebuilt (or unset) if the flower hierarchy is modified. Lookups in the index
+ * only read it, so may be made from several threads at once.
+ */
+extern TerminalCapIndex *getTerminalCap_index;
+
 /*
  * Returns non-zero iff the terminal adjacency is represented in the given set of events, which are specified by the set of event strings.
  */
 bool trueAdjacency(Cap *cap, stList *eventStrings);
 
+/*
+ * As trueAdjacency, but with the events given as an event set.
+ */
+bool trueAdjacencyInEventSet(Cap *cap, EventSet *eventSet);
+
 /*
  * Returns the segment of the terminal cap.
  */
@@ -75,6 +111,11 @@ bool capsAreAdjacent(Cap *cap1, Cap *cap2, int64_t *separationDistance);
  */
 bool endsAreConnected(End *end1, End *end2, stList *eventStrings);
 
+/*
+ * As endsAreConnected, but with the events given as an event set.
+ */
+bool endsAreConnectedInEventSet(End *end1, End *end2, EventSet *eventSet);
+
 /*
  * Returns non-zero iff the ends are adjacent by the sequences with the given events. If they
  * are minimumDistanceBetweenCaps is initialised to the minimum distance.
@@ -83,9 +124,21 @@ bool endsAreAdjacent(End *end1, End *end2,
         int64_t *minimumDistanceBetweenCaps,
         stList *eventStrings);
 
+/*
+ * As endsAreAdjacent, but with the events given as an event set.
+ */
+bool endsAreAdjacentInEventSet(End *end1, End *end2,
+        int64_t *minimumDistanceBetweenCaps,
+        EventSet *eventSet);
+
 /*
  * As endsAreAdjacent, but initialises cap1 and cap2 with the discovered caps.
  */
 bool endsAreAdjacent2(End *end1, End *end2, Cap **cap1, Cap **cap2, int64_t *minimumDistanceBetweenHaplotypeCaps, stList *eventStrings);
 
+/*
+ * As endsAreAdjacent2, but with the events given as an event set.
+ */
+bool endsAreAdjacent2InEventSet(End *end1, End *end2, Cap **cap1, Cap **cap2, int64_t *minimumDistanceBetweenHaplotypeCaps, EventSet *eventSet);
+
 #endif /* ASSEMBLY_STRUCTURES_H_ */
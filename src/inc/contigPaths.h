@@ -17,6 +17,22 @@
  */
 stList *getContigPaths(Flower *flower, const char *chosenEventString, stList *eventStrings);
 
+/*
+ * As getContigPaths, but the flowers of the hierarchy are divided between threadNumber threads. Returns the same set
+ * of contig paths as getContigPaths, but each path is oriented so that its first segment is on the positive strand
+ * and the paths are sorted by the name of their first segment.
+ */
+stList *getContigPathsInParallel(Flower *flower, const char *chosenEventString, stList *eventStrings, int64_t threadNumber);
+
+/*
+ * Checks that the contig paths are those of the chosen event (as returned by getContigPaths): that they are
+ * maximal, cover every haplotype segment of the event once and are made of adjacent haplotype segments. Aborts
+ * with a description of the first failed check. getContigPaths and getContigPathsInParallel only make these
+ * checks in builds without NDEBUG, as they walk the hierarchy again, so this is for validating the paths of
+ * release builds.
+ */
+void checkContigPaths(Flower *flower, stList *contigPaths, const char *chosenEventString, stList *eventStrings);
+
 /*
  * Get a hash of segments to contig paths.
  */
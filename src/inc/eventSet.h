@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef EVENT_SET_H_
+#define EVENT_SET_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * A set of events, built once from a list of event strings (event headers) and
+ * afterwards queried without any string comparisons.
+ *
+ * Events are identified by name, not by pointer, as each flower in the hierarchy has its own
+ * copy of the event tree. Each event in the set is given an index in [0, eventSet_size()),
+ * which can be used to build bitmasks over the set.
+ *
+ * The set lazily caches, for each end it is queried with, the bitmask of its events that label
+ * a cap of the end, and, for each block it is queried with, the segments of the block labelled with its events.
+ * If the flower is modified after the set is constructed the cache must be
+ * invalidated with eventSet_clearCache() or eventSet_invalidateEnd().
+ */
+typedef struct _eventSet EventSet;
+
+/*
+ * Constructs an event set containing every event in the flower's event tree whose header
+ * is one of the given event strings.
+ */
+EventSet *eventSet_construct(Flower *flower, stList *eventStrings);
+
+/*
+ * As eventSet_construct, but for a single event string.
+ */
+EventSet *eventSet_construct2(Flower *flower, const char *eventString);
+
+/*
+ * Frees the memory associated with the event set.
+ */
+void eventSet_destruct(EventSet *eventSet);
+
+/*
+ * Returns the number of events in the set.
+ */
+int64_t eventSet_size(EventSet *eventSet);
+
+/*
+ * Returns the index of the event in the set, or -1 if the event is not in the set.
+ */
+int64_t eventSet_getIndex(EventSet *eventSet, Event *event);
+
+/*
+ * Returns non-zero iff the event is in the set.
+ */
+bool eventSet_contains(EventSet *eventSet, Event *event);
+
+/*
+ * Returns the number of 64 bit words needed to hold a bitmask over the events of the set.
+ */
+int64_t eventSet_getMaskWordNumber(EventSet *eventSet);
+
+/*
+ * Fills mask (which must have eventSet_getMaskWordNumber() words) with the bitmask of the events
+ * in the set that label a cap of the end.
+ */
+void eventSet_getEndMask(EventSet *eventSet, End *end, uint64_t *mask);
+
+/*
+ * Returns the bitmask of the events in the set that label a cap of the end, computing it in one pass over
+ * the caps of the end the first time the end is queried. The mask is owned by the event set and remains valid
+ * until the cache entry is invalidated.
+ */
+const uint64_t *eventSet_getCachedEndMask(EventSet *eventSet, End *end);
+
+/*
+ * Returns non-zero iff the mask (as returned by eventSet_getCachedEndMask) contains any event.
+ */
+bool eventSet_maskIsNonEmpty(EventSet *eventSet, const uint64_t *mask);
+
+/*
+ * Returns the segments of the block that are labelled with an event of the set, oriented as the positively oriented
+ * block, and ordered by the name of their meta sequence (NULL_NAME for segments without a sequence). *metaSequenceNames
+ * is set to the array of these names and *segmentNumber to the number of segments. The segments are found the first time the block
+ * is queried. The arrays are owned by the event set and remain valid until the cache is cleared.
+ */
+Segment **eventSet_getCachedBlockSegments(EventSet *eventSet, Block *block, const Name **metaSequenceNames,
+        int64_t *segmentNumber);
+
+/*
+ * Removes the cached mask of the given end, if any.
+ */
+void eventSet_invalidateEnd(EventSet *eventSet, End *end);
+
+/*
+ * Removes all cached end masks and block segments.
+ */
+void eventSet_clearCache(EventSet *eventSet);
+
+#endif /* EVENT_SET_H_ */
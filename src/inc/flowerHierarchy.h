@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef FLOWER_HIERARCHY_H_
+#define FLOWER_HIERARCHY_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * Gets the flower and all its nested flowers, in depth first order. The walk loads every flower, so it
+ * is done serially, before jobs over the flowers are handed to runInParallel.
+ */
+stList *getNestedFlowers(Flower *flower);
+
+/*
+ * Calls visitFn(nestedFlower, results, extraArg) for the flower and each of its nested flowers, using threadNumber
+ * threads (see runInParallel), and returns the concatenation of the results lists. Each thread appends to its own
+ * results list, so visitFn needs no locking, but the order of the results is not defined. The flowers are loaded
+ * serially first, so visitFn must only read them.
+ */
+stList *getFromNestedFlowersInParallel(Flower *flower,
+        void (*visitFn)(Flower *nestedFlower, stList *results, void *extraArg), void *extraArg, int64_t threadNumber);
+
+/*
+ * Gets the positively oriented segments of the flower and its nested flowers, in no defined order, using threadNumber threads.
+ */
+stList *getNestedSegmentsInParallel(Flower *flower, int64_t threadNumber);
+
+#endif /* FLOWER_HIERARCHY_H_ */
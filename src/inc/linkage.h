@@ -9,12 +9,22 @@
 
 #include "cactus.h"
 #include "sonLib.h"
+#include "eventSet.h"
+#include "segmentIndex.h"
+#include "linkageHistogram.h"
 
 /*
- * Gets the segments in increasing order of the sequence.
+ * Gets the segments in increasing order of the sequence. For finding the segment containing
+ * a position use a SegmentIndex instead.
  */
 stSortedSet *getOrderedSegments(Flower *flower);
 
+/*
+ * As getOrderedSegments, walking the flowers with threadNumber threads (see runInParallel). The flowers
+ * are loaded serially first.
+ */
+stSortedSet *getOrderedSegmentsInParallel(Flower *flower, int64_t threadNumber);
+
 /*
  * Picks a two points along the sequence.
  * Size of gap between the two points is picked
@@ -26,25 +36,94 @@ void pickAPairOfPoints(MetaSequence *metaSequence, int64_t *x, int64_t *y);
 /*
  * Returns non-zero iff the two segments are within blocks that (1) both have a common sequence labelled
  * with the event identified by event string, (2) are in the same order and orientation with respect to the sequence identified
- * by (1). Both segmentX and segmentY must be part of the same (meta)sequence.
+ * by (1). Both segmentX and segmentY must be part of the same (meta)sequence. Aligned is initialised
+ * to non-zero iff both segments are aligned to a sequence labelled with the event, whether or not they are linked.
  */
-bool linked(Segment *segmentX, Segment *segmentY, int64_t difference, const char *eventString);
+bool linked(Segment *segmentX, Segment *segmentY, int64_t difference, const char *eventString, bool *aligned);
+
+/*
+ * As linked, but with the event given as an event set.
+ */
+bool linkedInEventSet(Segment *segmentX, Segment *segmentY, int64_t difference, EventSet *eventSet, bool *aligned);
 
 /*
  * Samples sampleNumber pairs of positions separated by distance from 1 to bucketNumber*bucketSize.
  * int64_t *correct and *samples are arrays which must be of at least bucketNumber length, and are used
  * to accumulate sample events and record the number of correct pairs. The aligned array
  * records samples which are aligned, but not neccesarily correctly linked. Samples are picked using
- * pickAPairOfPoints().
+ * pickAPairOfPoints(). The segments containing the sampled points are found with the segment index.
  */
 void samplePoints(Flower *flower, MetaSequence *metaSequence,
         const char *eventString,
         int64_t sampleNumber, int64_t *correct, int64_t *aligned, int64_t *samples,
-        int64_t bucketNumber, double bucketSize, stSortedSet *sortedSegments,  bool duplication, double proportionOfSequence);
+        int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,  bool duplication, double proportionOfSequence);
 
 void samplePointsWithOtherReference(Flower *flower, MetaSequence *metaSequence,
         const char *eventString, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
-        int64_t *samples, int64_t bucketNumber, double bucketSize, stSortedSet *sortedSegments,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence);
+
+/*
+ * As samplePoints, or, if otherEventString is non-NULL, samplePointsWithOtherReference, but for a list of event strings
+ * at once: each sampled pair is located once and tested against every event. correct and aligned are
+ * matrices of stList_length(eventStrings) * bucketNumber counts, the count of event i and bucket j being at index
+ * i * bucketNumber + j. samples has bucketNumber counts, shared by all the events.
+ */
+void samplePointsForEvents(Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence);
+
+/*
+ * As samplePoints, or, if otherEventString is non-NULL, samplePointsWithOtherReference, but drawing the samples
+ * with threadNumber threads. The samples are drawn from a counter based random number stream identified by the seed
+ * (RANDOM() is not used), so the result depends only on the seed, not on the number of threads.
+ * Each thread has private copies of the event sets and bucket arrays, which are added to correct, aligned and samples at the end.
+ * See runInParallel for the restrictions on the flower hierarchy while sampling.
+ */
+void samplePointsInParallel(Flower *flower, MetaSequence *metaSequence,
+        const char *eventString, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, uint64_t seed, int64_t threadNumber);
+
+/*
+ * As samplePointsInParallel, for a list of event strings, with the counts arranged as for samplePointsForEvents.
+ */
+void samplePointsForEventsInParallel(Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, int64_t *correct, int64_t *aligned,
+        int64_t *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, uint64_t seed, int64_t threadNumber);
+
+/*
+ * Continues the sampling run of the histogram (as samplePointsForEventsInParallel, with the histogram's seed,
+ * events and buckets) until it has sampleNumber samples, drawing the stream positions that follow those already drawn.
+ * If checkpointFile is non-NULL the histogram is checkpointed to it after every checkpointInterval samples (or
+ * only at the end if checkpointInterval <= 0), so that a preempted run can be resumed by loading the
+ * checkpoint and calling this function again. The result does not depend on the checkpoint interval or thread number.
+ * Aborts if the histogram is merged or has a different number of events.
+ */
+void samplePointsIntoHistogram(LinkageHistogram *linkageHistogram, Flower *flower, MetaSequence *metaSequence,
+        stList *eventStrings, const char *otherEventString, int64_t sampleNumber, SegmentIndex *segmentIndex,
+        bool duplication, double proportionOfSequence, int64_t threadNumber,
+        const char *checkpointFile, int64_t checkpointInterval);
+
+/*
+ * Computes exactly the expected values of the counts samplePoints (or, if otherEventString is non-NULL,
+ * samplePointsWithOtherReference) accumulates, per sample: samples[b] is increased by the probability that a sample
+ * falls in bucket b, and correct[b] and aligned[b] by the probability that it also is correct, respectively aligned.
+ * Multiplying by a sample number gives the expected counts of the samplers, so correct[b] / samples[b] is the
+ * fraction the samplers estimate.
+ *
+ * The aligned mass is found with prefix sums over the segments whose blocks have segments in the event set, in time
+ * proportional to the number of segments times a few thousand pieces of the range of distances, and the correct mass
+ * from the pairs of segments whose blocks have segments on the same assembly sequence in the right order, each tested
+ * with linkedInEventSet once. Beyond distances of a few thousand bases the weights of the distances are interpolated
+ * linearly within each piece, which changes a count by less than a relative 2e-5, and far less once summed over
+ * many pairs of segments. The memory used is linear in the number of segments.
+ */
+void getExactLinkage(Flower *flower, MetaSequence *metaSequence,
+        const char *eventString, const char *otherEventString, double *correct, double *aligned,
+        double *samples, int64_t bucketNumber, double bucketSize, SegmentIndex *segmentIndex,
         bool duplication, double proportionOfSequence);
 
 /*
@@ -52,4 +131,9 @@ void samplePointsWithOtherReference(Flower *flower, MetaSequence *metaSequence,
  */
 stSortedSet *getMetaSequencesForEvents(Flower *flower, stList *eventStrings);
 
+/*
+ * As getMetaSequencesForEvents, walking the flowers with threadNumber threads.
+ */
+stSortedSet *getMetaSequencesForEventsInParallel(Flower *flower, stList *eventStrings, int64_t threadNumber);
+
 #endif /* LINKAGE_H_ */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef LINKAGE_HISTOGRAM_H_
+#define LINKAGE_HISTOGRAM_H_
+
+#include <stdio.h>
+
+#include "sonLib.h"
+
+/*
+ * The counts of a linkage sampling run (see samplePointsForEvents), with what is needed to continue it:
+ * for each of eventNumber events and bucketNumber buckets the correct and aligned counts, the samples count of each
+ * bucket, and the seed and range of the counter based random stream the samples were drawn from. The samples
+ * drawn are those of the stream positions [firstSample, firstSample + sampleNumber).
+ *
+ * Histograms can be written to and read from a small binary file, so that a run can be checkpointed and resumed,
+ * and histograms of different shards of a run (runs with other seeds or disjoint sample ranges) can be merged.
+ */
+typedef struct _linkageHistogram LinkageHistogram;
+
+/*
+ * Constructs an empty histogram, for samples drawn from position firstSample of the stream identified by the seed.
+ */
+LinkageHistogram *linkageHistogram_construct(int64_t eventNumber, int64_t bucketNumber, double bucketSize,
+        uint64_t seed, int64_t firstSample);
+
+/*
+ * Frees the memory associated with the histogram.
+ */
+void linkageHistogram_destruct(LinkageHistogram *linkageHistogram);
+
+int64_t linkageHistogram_getEventNumber(LinkageHistogram *linkageHistogram);
+
+int64_t linkageHistogram_getBucketNumber(LinkageHistogram *linkageHistogram);
+
+double linkageHistogram_getBucketSize(LinkageHistogram *linkageHistogram);
+
+uint64_t linkageHistogram_getSeed(LinkageHistogram *linkageHistogram);
+
+int64_t linkageHistogram_getFirstSample(LinkageHistogram *linkageHistogram);
+
+/*
+ * Returns non-zero iff other histograms have been merged into the histogram, see linkageHistogram_merge.
+ */
+bool linkageHistogram_isMerged(LinkageHistogram *linkageHistogram);
+
+/*
+ * Returns the number of samples drawn so far.
+ */
+int64_t linkageHistogram_getSampleNumber(LinkageHistogram *linkageHistogram);
+
+/*
+ * Records that a further sampleNumber samples have been drawn (and their counts added). Aborts if the
+ * histogram is merged.
+ */
+void linkageHistogram_addSampleNumber(LinkageHistogram *linkageHistogram, int64_t sampleNumber);
+
+/*
+ * Returns the eventNumber * bucketNumber correct counts, the count of event i and bucket j being at
+ * index i * bucketNumber + j. The array is owned by the histogram and may be added to.
+ */
+int64_t *linkageHistogram_getCorrect(LinkageHistogram *linkageHistogram);
+
+/*
+ * As linkageHistogram_getCorrect, for the aligned counts.
+ */
+int64_t *linkageHistogram_getAligned(LinkageHistogram *linkageHistogram);
+
+/*
+ * Returns the bucketNumber samples counts. The array is owned by the histogram and may be added to.
+ */
+int64_t *linkageHistogram_getSamples(LinkageHistogram *linkageHistogram);
+
+/*
+ * Adds the counts and sample number of linkageHistogram2 to linkageHistogram. The histograms must have the
+ * same events and buckets, and their samples must not overlap, that is, no stream position of a seed may be drawn
+ * by both; otherwise the merge aborts. The merged histogram records the sample ranges of all its shards, so that
+ * further merges are checked too. A merged histogram is a summary of its shards and can not be sampled further.
+ */
+void linkageHistogram_merge(LinkageHistogram *linkageHistogram, LinkageHistogram *linkageHistogram2);
+
+/*
+ * Writes the histogram to the file in a binary format, to be read back with linkageHistogram_load.
+ */
+void linkageHistogram_write(LinkageHistogram *linkageHistogram, FILE *fileHandle);
+
+/*
+ * Reads a histogram written by linkageHistogram_write. Aborts if the file is not a valid histogram.
+ */
+LinkageHistogram *linkageHistogram_load(FILE *fileHandle);
+
+/*
+ * Writes the histogram to the given file, replacing it atomically, so that an interrupted checkpoint
+ * leaves the previous one intact.
+ */
+void linkageHistogram_checkpoint(LinkageHistogram *linkageHistogram, const char *fileName);
+
+/*
+ * Reads the histogram from the given checkpoint file, or returns NULL if the file does not exist.
+ */
+LinkageHistogram *linkageHistogram_loadCheckpoint(const char *fileName);
+
+#endif /* LINKAGE_HISTOGRAM_H_ */
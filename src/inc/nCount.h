@@ -0,0 +1,18 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef N_COUNT_H_
+#define N_COUNT_H_
+
+#include "sonLib.h"
+
+/*
+ * Returns the number of 'N' or 'n' characters in the first length characters of the string, which need
+ * not be null terminated. Uses AVX2 or SSE2 where the CPU supports them, detected at run time.
+ */
+int64_t countNs(const char *string, int64_t length);
+
+#endif /* N_COUNT_H_ */
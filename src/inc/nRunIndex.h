@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef N_RUN_INDEX_H_
+#define N_RUN_INDEX_H_
+
+#include <stdio.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * An index of the runs of Ns in a set of meta sequences, so that the number of Ns in any interval
+ * of an indexed meta sequence can be found by binary search, without fetching its sequence.
+ *
+ * Meta sequences are identified by name, and coordinates are those of the meta sequence (which are
+ * also the coordinates of the sequences and caps that refer to it). Once built the index is read only,
+ * so may be shared between threads.
+ */
+typedef struct _nRunIndex NRunIndex;
+
+/*
+ * Constructs an empty index.
+ */
+NRunIndex *nRunIndex_construct(void);
+
+/*
+ * Constructs an index of the meta sequences of all the sequences in the flower.
+ */
+NRunIndex *nRunIndex_construct2(Flower *flower);
+
+/*
+ * Frees the memory associated with the index.
+ */
+void nRunIndex_destruct(NRunIndex *nRunIndex);
+
+/*
+ * Adds the meta sequence to the index, if not already present, scanning its sequence a chunk at a time.
+ */
+void nRunIndex_addMetaSequence(NRunIndex *nRunIndex, MetaSequence *metaSequence);
+
+/*
+ * Returns the number of Ns in the interval [start, start + length) of the meta sequence, or -1 if
+ * the meta sequence is not in the index.
+ */
+int64_t nRunIndex_countNs(NRunIndex *nRunIndex, MetaSequence *metaSequence, int64_t start, int64_t length);
+
+/*
+ * Writes the index to the file in a binary format, to be read back with nRunIndex_load.
+ */
+void nRunIndex_write(NRunIndex *nRunIndex, FILE *fileHandle);
+
+/*
+ * Reads an index written by nRunIndex_write. Aborts if the file is not a valid index.
+ */
+NRunIndex *nRunIndex_load(FILE *fileHandle);
+
+#endif /* N_RUN_INDEX_H_ */
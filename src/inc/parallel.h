@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "sonLib.h"
+
+/*
+ * Calls jobFn(jobIndex, threadIndex, extraArg) for every jobIndex in [0, jobNumber), using threadNumber threads
+ * (threadIndex is in [0, threadNumber)). Jobs are handed out one at a time in increasing order, so a thread that
+ * finishes its job early takes the next unclaimed one. If threadNumber <= 1 the jobs are run in order in the calling thread.
+ *
+ * The cactus API is not thread safe in general (for example flowers are loaded lazily from the cactus disk), so jobFn
+ * must only read objects that have already been loaded, and must not call functions that use static state.
+ */
+void runInParallel(int64_t jobNumber, int64_t threadNumber,
+        void (*jobFn)(int64_t jobIndex, int64_t threadIndex, void *extraArg), void *extraArg);
+
+/*
+ * Sorts the elementNumber elements of size elementSize at base, as qsort, using threadNumber threads. Runs of the
+ * array are sorted concurrently and then merged pairwise. Unlike qsort the merges are stable, but the runs are not.
+ */
+void sortInParallel(void *base, int64_t elementNumber, size_t elementSize,
+        int (*cmpFn)(const void *, const void *), int64_t threadNumber);
+
+#endif /* PARALLEL_H_ */
@@ -16,12 +16,24 @@
 typedef struct _sequenceInterval {
         int64_t start;
         int64_t end;
-        char *sequenceName;
+        const char *sequenceName;
+        bool ownsSequenceName;
 } SequenceInterval;
 
+/*
+ * Constructs an interval, with a copy of the sequence name.
+ */
 SequenceInterval *sequenceInterval_construct(int64_t start, int64_t end,
         const char *sequenceName);
 
+/*
+ * As sequenceInterval_construct, but the interval refers to the given sequence name rather than copying it,
+ * so the name must outlive the interval. The interval functions below use this with the headers of
+ * the cactus sequences, so their intervals are only valid while the sequences are loaded.
+ */
+SequenceInterval *sequenceInterval_construct2(int64_t start, int64_t end,
+        const char *sequenceName);
+
 void sequenceInterval_destruct(SequenceInterval *sequenceInterval);
 
 stList *getContigPathIntervals(Flower *flower, stList *contigPaths, const char *chosenEventString, stList *referenceEventStrings);
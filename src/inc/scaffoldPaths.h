@@ -21,4 +21,14 @@ stHash *getContigPathToScaffoldPathLengthsHash(stList *contigPaths, stList *hapl
  */
 stHash *getScaffoldPaths(stList *contigPaths, stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters);
 
+/*
+ * Checks that contig paths joined by a scaffold or ambiguity gap are in the same scaffold path, in the hash of
+ * contig paths to scaffold paths (as returned by getScaffoldPaths), and have the same scaffold path length, in the
+ * hash of contig paths to lengths (as returned by getContigPathToScaffoldPathLengthsHash). Either hash may be NULL,
+ * to skip its checks. Aborts with a description of the first failed check. The functions above only make these
+ * checks in builds without NDEBUG.
+ */
+void checkScaffoldPaths(stList *contigPaths, stHash *contigPathToScaffoldPathHash, stHash *contigPathToScaffoldPathLengthsHash,
+        stList *haplotypeEventStrings, stList *contaminationEventStrings, CapCodeParameters *capCodeParameters);
+
 #endif /* SCAFFOLD_PATHS_H_ */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten (at) gmail.com) and Dent Earl (dearl (at) soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef SEGMENT_INDEX_H_
+#define SEGMENT_INDEX_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * An index of the positively oriented segments of a flower hierarchy, for finding the segment
+ * containing a position of a meta sequence.
+ *
+ * The segments of each meta sequence are held in order of start coordinate in flat arrays of starts,
+ * lengths and segments, which are searched with a branch free binary search. Alongside each segment the index
+ * records whether the segment is duplicated, that is, whether another segment of its block lies on the same meta sequence. Meta sequences are
+ * identified by name. The index holds no state between lookups, so once built may be used
+ * by many threads at once.
+ */
+typedef struct _segmentIndex SegmentIndex;
+
+/*
+ * Constructs an index of the segments of the flower and all its nested flowers. The segments are collected,
+ * sorted and their duplication flags computed with threadNumber threads (see runInParallel).
+ */
+SegmentIndex *segmentIndex_construct(Flower *flower, int64_t threadNumber);
+
+/*
+ * Constructs an index of the segments in the sorted set (as returned by getOrderedSegments).
+ */
+SegmentIndex *segmentIndex_construct2(stSortedSet *sortedSegments, int64_t threadNumber);
+
+/*
+ * Frees the memory associated with the index.
+ */
+void segmentIndex_destruct(SegmentIndex *segmentIndex);
+
+/*
+ * Returns the number of segments in the index on the meta sequence.
+ */
+int64_t segmentIndex_getSegmentNumber(SegmentIndex *segmentIndex, MetaSequence *metaSequence);
+
+/*
+ * Returns the positively oriented segment containing coordinate x of the meta sequence, or NULL
+ * if there is none.
+ */
+Segment *segmentIndex_getSegment(SegmentIndex *segmentIndex, MetaSequence *metaSequence, int64_t x);
+
+/*
+ * A lookup context for the segments of one meta sequence in an index, which carries everything a lookup
+ * needs, so that repeated lookups skip finding the meta sequence. The arrays hold the segments in order, with
+ * their starts, lengths and duplication flags. Cursors are owned by the caller (they
+ * may live on the stack, and need no destruction) and remain valid as long as the index.
+ */
+typedef struct _segmentIndexCursor {
+    const int64_t *starts;
+    const int64_t *lengths;
+    Segment **segments;
+    const bool *duplicated;
+    int64_t segmentNumber;
+} SegmentIndexCursor;
+
+/*
+ * Initialises the cursor to look up segments of the given meta sequence.
+ */
+void segmentIndex_initialiseCursor(SegmentIndex *segmentIndex, MetaSequence *metaSequence, SegmentIndexCursor *cursor);
+
+/*
+ * As segmentIndex_getSegment, for the cursor's meta sequence.
+ */
+Segment *segmentIndexCursor_getSegment(SegmentIndexCursor *cursor, int64_t x);
+
+/*
+ * As segmentIndexCursor_getSegment, for a series of queries in non-decreasing order of x. The search starts from,
+ * and updates, *position, which should be zero for the first query of the series. Each search gallops forward
+ * from the previous one, so a sorted series of k queries over n segments takes O(k log(n / k)) time.
+ */
+Segment *segmentIndexCursor_getNextSegment(SegmentIndexCursor *cursor, int64_t x, int64_t *position);
+
+#endif /* SEGMENT_INDEX_H_ */